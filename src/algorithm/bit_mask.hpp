@@ -0,0 +1,108 @@
+#ifndef BIT_MASK_H
+#define BIT_MASK_H
+
+#include <cstdlib>
+#include <cstddef>
+#include <new>
+#include <stdint.h>
+#include "common.hpp"
+
+namespace betweenness_centrality {
+
+  // Fixed set of 64 * W bits. The loops over the words are unrolled by the
+  // compiler, so BitMask<1> costs the same as a plain uint64_t.
+  template <int W> struct BitMask {
+    static const int kNumBits = 64 * W;
+    uint64_t words[W];
+
+    BitMask(){ for (int i = 0; i < W; i++) words[i] = 0; }
+
+    inline bool Test(int pos) const { return (words[pos >> 6] >> (pos & 63)) & 1; }
+    inline void Set(int pos, bool bit){
+      uint64_t &w = words[pos >> 6];
+      w = (w & ~(uint64_t(1) << (pos & 63))) | (uint64_t(bit) << (pos & 63));
+    }
+
+    inline bool Any() const {
+      uint64_t x = 0;
+      for (int i = 0; i < W; i++) x |= words[i];
+      return x != 0;
+    }
+    // Whether this and m share a bit.
+    inline bool Intersects(const BitMask &m) const {
+      uint64_t x = 0;
+      for (int i = 0; i < W; i++) x |= words[i] & m.words[i];
+      return x != 0;
+    }
+    // Whether this has a bit that m does not.
+    inline bool AnyNotIn(const BitMask &m) const {
+      uint64_t x = 0;
+      for (int i = 0; i < W; i++) x |= words[i] & ~m.words[i];
+      return x != 0;
+    }
+    inline BitMask AndNot(const BitMask &m) const {
+      BitMask res;
+      for (int i = 0; i < W; i++) res.words[i] = words[i] & ~m.words[i];
+      return res;
+    }
+    inline BitMask operator&(const BitMask &m) const {
+      BitMask res;
+      for (int i = 0; i < W; i++) res.words[i] = words[i] & m.words[i];
+      return res;
+    }
+    inline bool operator==(const BitMask &m) const {
+      uint64_t x = 0;
+      for (int i = 0; i < W; i++) x |= words[i] ^ m.words[i];
+      return x == 0;
+    }
+    inline bool operator!=(const BitMask &m) const { return !(*this == m); }
+
+    // Calls f(pos) for each set bit, in increasing order.
+    template <typename F> inline void ForEachBit(F f) const {
+      for (int i = 0; i < W; i++){
+        for (uint64_t x = words[i]; x != 0; x &= x - 1) f(i * 64 + __builtin_ctzll(x));
+      }
+    }
+  };
+
+  template <int W> const int BitMask<W>::kNumBits;
+
+  // Allocator for vectors of types whose alignment is larger than that of
+  // operator new in C++11, such as ones aligned to cache lines.
+  template <typename T> class AlignedAllocator {
+  public:
+    typedef T         value_type;
+    typedef T*        pointer;
+    typedef const T*  const_pointer;
+    typedef T&        reference;
+    typedef const T&  const_reference;
+    typedef size_t    size_type;
+    typedef ptrdiff_t difference_type;
+    template <typename U> struct rebind { typedef AlignedAllocator<U> other; };
+
+    AlignedAllocator() {}
+    template <typename U> AlignedAllocator(const AlignedAllocator<U> &) {}
+
+    pointer allocate(size_type n, const void * = 0){
+      void *p = nullptr;
+      size_t alignment = alignof(T) < sizeof(void*) ? sizeof(void*) : alignof(T);
+      CHECK(n == 0 || posix_memalign(&p, alignment, n * sizeof(T)) == 0);
+      return static_cast<pointer>(p);
+    }
+    void deallocate(pointer p, size_type){ free(p); }
+
+    pointer       address(reference x) const { return &x; }
+    const_pointer address(const_reference x) const { return &x; }
+    size_type max_size() const { return static_cast<size_type>(-1) / sizeof(T); }
+
+    void construct(pointer p, const T &val){ new(p) T(val); }
+    void destroy(pointer p){ p->~T(); }
+  };
+
+  template <typename T, typename U>
+  inline bool operator==(const AlignedAllocator<T> &, const AlignedAllocator<U> &){ return true; }
+  template <typename T, typename U>
+  inline bool operator!=(const AlignedAllocator<T> &, const AlignedAllocator<U> &){ return false; }
+}
+
+#endif /* BIT_MASK_H */
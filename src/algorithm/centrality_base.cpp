@@ -2,45 +2,193 @@
 #include <cassert>
 #include <queue>
 #include <algorithm>
+#include <thread>
 using namespace std;
 
 namespace betweenness_centrality {
+  namespace {
+    // Runs f(0), ..., f(num_threads - 1) at the same time.
+    template <typename F> void RunThreads(int num_threads, const F &f){
+      vector<thread> threads;
+      for (int t = 1; t < num_threads; t++) threads.emplace_back(f, t);
+      f(0);
+      for (auto &th : threads) th.join();
+    }
+
+    // Stable counting sort of the items [0, m) by keys[i] < n into a CSR
+    // (offsets, values). Item ranges are counted and scattered by separate
+    // threads, each writing after the items of the threads before it.
+    void CountingSort(const int *keys, const int *values, size_t m, size_t n, int num_threads,
+                      vector<size_t> &offsets, vector<int> &sorted){
+      vector<size_t> count(num_threads * n, 0);
+      auto items = [&](int t, size_t &begin, size_t &end){
+        begin = m * t / num_threads;
+        end   = m * (t + 1) / num_threads;
+      };
+      RunThreads(num_threads, [&](int t){
+          size_t begin, end;
+          items(t, begin, end);
+          size_t *c = &count[t * n];
+          for (size_t i = begin; i < end; i++) c[keys[i]]++;
+        });
+
+      offsets.assign(n + 1, 0);
+      for (size_t k = 0; k < n; k++){
+        size_t pos = offsets[k];
+        for (int t = 0; t < num_threads; t++){
+          size_t c = count[t * n + k];
+          count[t * n + k] = pos;
+          pos += c;
+        }
+        offsets[k + 1] = pos;
+      }
+
+      sorted.resize(m);
+      RunThreads(num_threads, [&](int t){
+          size_t begin, end;
+          items(t, begin, end);
+          size_t *pos = &count[t * n];
+          for (size_t i = begin; i < end; i++) sorted[pos[keys[i]]++] = values[i];
+        });
+    }
+
+    // Appends the edges other than self loops to (src, dst), with the vertices renumbered.
+    template <typename F> void RenumberEdges(const vector<pair<int, int> > &es, F renumber, vector<int> &src, vector<int> &dst){
+      src.reserve(es.size());
+      dst.reserve(es.size());
+      for (const auto &e : es){
+        int u = renumber(e.fst);
+        int v = renumber(e.snd);
+        if (u != v){
+          src.push_back(u);
+          dst.push_back(v);
+        }
+      }
+    }
+
+    // Copies each vertex's range of a CSR into its own list.
+    void CopyLists(const vector<size_t> &offsets, const int *adj, int num_threads, vector<vector<int> > &lists){
+      size_t n = offsets.size() - 1;
+      lists.resize(n);
+      RunThreads(num_threads, [&](int t){
+          for (size_t v = n * t / num_threads; v < n * (t + 1) / num_threads; v++){
+            lists[v].assign(adj + offsets[v], adj + offsets[v + 1]);
+          }
+        });
+    }
+
+    // Threads keep n counters each, so they are used only when there are enough entries per vertex.
+    int NumSortThreads(size_t m, size_t n){
+      return max<size_t>(1, min<size_t>({thread::hardware_concurrency(), m / (size_t(1) << 16), m / n}));
+    }
+
+    // The vertex that each entry of a CSR belongs to.
+    vector<int> Owners(const vector<size_t> &offsets){
+      size_t n = offsets.size() - 1;
+      vector<int> owners(offsets[n]);
+      for (size_t v = 0; v < n; v++){
+        fill(owners.begin() + offsets[v], owners.begin() + offsets[v + 1], v);
+      }
+      return owners;
+    }
+  }
+
   void CentralityBase::BuildGraph(const vector<pair<int, int> > &es){
     // CHECK(!es.empty());
     vertex2id.clear();
     G[0].clear();
     G[1].clear();
     
-    if (!es.empty()){
-      V = 0;
-      E = es.size();
-      for (const auto &e : es){
-        if (vertex2id.count(e.fst) == 0) vertex2id[e.fst] = V++;
-        if (vertex2id.count(e.snd) == 0) vertex2id[e.snd] = V++;
-      }
-      G[0].resize(V);
-      G[1].resize(V);
-      for (const auto &e : es){
-        int u = vertex2id[e.fst];
-        int v = vertex2id[e.snd];
-        if (u != v){
-          G[0][u].push_back(v);
-          G[1][v].push_back(u);
-        }
-      }
-    } else {
+    if (es.empty()){
       V = 1;
       E = 0;
       G[0].resize(V);
       G[1].resize(V);
       vertex2id[0] = 0;
+      return;
+    }
+    
+    // Vertices are numbered in the order in which they first appear. When
+    // the labels fall in a compact range (e.g. 0..n-1), a flat table
+    // replaces the hash table.
+    E = es.size();
+    vector<int> labels;
+    vector<int> src, dst;
+    int lo = es[0].fst, hi = es[0].fst;
+    for (const auto &e : es){
+      lo = min({lo, e.fst, e.snd});
+      hi = max({hi, e.fst, e.snd});
     }
+    if (uint64_t(int64_t(hi) - lo) < 4 * E){
+      vector<int> table(size_t(int64_t(hi) - lo) + 1, -1);
+      RenumberEdges(es, [&](int x){
+          int &id = table[x - lo];
+          if (id < 0){
+            id = labels.size();
+            labels.push_back(x);
+          }
+          return id;
+        }, src, dst);
+    } else {
+      unordered_map<int, int> table;
+      RenumberEdges(es, [&](int x){
+          auto res = table.emplace(x, labels.size());
+          if (res.snd) labels.push_back(x);
+          return res.fst->snd;
+        }, src, dst);
+    }
+    V = labels.size();
+    vertex2id.reserve(V);
+    for (size_t v = 0; v < V; v++) vertex2id[labels[v]] = v;
+    CHECK(V == vertex2id.size());
+    
+    // Radix sort of the edges, by source and then by target: sorting by
+    // target lists the sources of each vertex, and sorting those entries by
+    // source again lists the targets of each vertex in increasing order.
+    // Each pass keeps the order of the previous one, so the reverse lists
+    // come out sorted as well.
+    size_t m = src.size();
+    int num_threads = NumSortThreads(m, V);
+    vector<size_t> offsets[2];
+    vector<int>    adj[2];
+    CountingSort(dst.data(), src.data(), m, V, num_threads, offsets[1], adj[1]);
+    vector<int>().swap(src);
+    vector<int>().swap(dst);
+    CountingSort(adj[1].data(), Owners(offsets[1]).data(), m, V, num_threads, offsets[0], adj[0]);
+    CountingSort(adj[0].data(), Owners(offsets[0]).data(), m, V, num_threads, offsets[1], adj[1]);
+    
+    for (int i = 0; i < 2; i++) CopyLists(offsets[i], adj[i].data(), num_threads, G[i]);
+  }
 
-    for (size_t v = 0; v < V; v++){
-      sort(G[0][v].begin(), G[0][v].end());
-      sort(G[1][v].begin(), G[1][v].end());
+  void CentralityBase::BuildGraph(const MappedGraph &graph){
+    if (graph.NumVertices() == 0){
+      BuildGraph(vector<pair<int, int> >());
+      return;
     }
+    
+    V = graph.NumVertices();
+    E = graph.NumEdges();
+    const uint64_t *offsets = graph.Offsets();
+    const int32_t  *targets = graph.Targets();
+    const int32_t  *ids     = graph.OriginalIds();
+    
+    vertex2id.clear();
+    vertex2id.reserve(V);
+    for (size_t v = 0; v < V; v++) vertex2id[ids[v]] = v;
     CHECK(V == vertex2id.size());
+    
+    // adjacency lists are sorted in the file, and sorting their entries by
+    // target keeps the sources of each reverse list in increasing order
+    size_t m = offsets[V];
+    for (size_t i = 0; i < m; i++){
+      CHECK(0 <= targets[i] && (size_t)targets[i] < V);
+    }
+    int num_threads = NumSortThreads(m, V);
+    vector<size_t> forward_offsets(offsets, offsets + V + 1), backward_offsets;
+    vector<int>    backward;
+    CountingSort(targets, Owners(forward_offsets).data(), m, V, num_threads, backward_offsets, backward);
+    CopyLists(forward_offsets, targets, num_threads, G[0]);
+    CopyLists(backward_offsets, backward.data(), num_threads, G[1]);
   }
 }
 
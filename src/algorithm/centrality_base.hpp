@@ -2,6 +2,7 @@
 #define CENTRALITY_H
 
 #include "common.hpp"
+#include "graph_io.hpp"
 #include <vector>
 #include <unordered_map>
 using std::vector;
@@ -16,11 +17,25 @@ namespace betweenness_centrality {
     vector<vector<int> > G[2];
     unordered_map<int, int> vertex2id;
     void BuildGraph(const vector<std::pair<int, int> > &es);
+    // Same as above for the edge list the file was written from, but without hashing vertices.
+    void BuildGraph(const MappedGraph &graph);
     
   public:
     virtual ~CentralityBase(){};
     virtual void PreCompute(const vector<std::pair<int, int> > &es, int num_samples = -1) = 0;
+    // Builds from a binary graph file. Classes that do not override this get the edge list of the file.
+    virtual void PreCompute(const MappedGraph &graph, int num_samples = -1){
+      PreCompute(graph.ToEdgeList(), num_samples);
+    }
     virtual double QueryCentrality(int v) const = 0;
+    // Fills res with (vertex, centrality) of every vertex, in no particular
+    // order. Derived classes override this with a linear pass over their
+    // scores; the default looks up each vertex with QueryCentrality.
+    virtual void QueryAllCentralities(vector<std::pair<int, double> > &res) const {
+      res.clear();
+      res.reserve(vertex2id.size());
+      for (const auto &p : vertex2id) res.emplace_back(p.first, QueryCentrality(p.first));
+    }
   };
 }
 
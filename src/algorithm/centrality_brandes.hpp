@@ -11,6 +11,11 @@ namespace betweenness_centrality {
     virtual double QueryCentrality(int v) const {
       return vertex2id.count(v) ? centrality_map[vertex2id.at(v)] : 0;
     }
+    virtual void QueryAllCentralities(vector<std::pair<int, double> > &res) const {
+      res.clear();
+      res.reserve(vertex2id.size());
+      for (const auto &p : vertex2id) res.emplace_back(p.first, centrality_map[p.second]);
+    }
   };
 
 }
@@ -0,0 +1,103 @@
+#ifndef CENTRALITY_WATCH_H
+#define CENTRALITY_WATCH_H
+
+#include <vector>
+#include <functional>
+#include <unordered_map>
+#include <climits>
+#include <algorithm>
+#include "common.hpp"
+using std::vector;
+
+namespace betweenness_centrality {
+
+  enum CrossingDirection {
+    UPWARD,          // from below the threshold to at or above it
+    DOWNWARD,        // from at or above the threshold to below it
+    BOTH_DIRECTIONS,
+  };
+
+  // The centrality of vertex crossed the threshold of watch watch_id.
+  struct CrossingEvent {
+    int    watch_id;
+    int    vertex;
+    double old_centrality;
+    double new_centrality;
+  };
+
+  typedef std::function<void(const CrossingEvent &)> CrossingHandler;
+
+  // Thresholds that clients watch on the centrality of single vertices or of
+  // every vertex. The engine reports the centrality of each vertex before and
+  // after an update to Check, and passes the events to Emit once it is done.
+  class CentralityWatches {
+  private:
+    struct Watch {
+      int               vertex;
+      double            threshold;
+      CrossingDirection direction;
+      CrossingHandler   handler;  // empty once removed
+    };
+    vector<Watch> watches;    // ids are not reused, so that Emit never calls the handler of a later watch
+    size_t        num_watches;
+    vector<int>   global_watches;
+    std::unordered_map<int, vector<int> > vertex_watches;
+
+    inline void CheckWatch(int id, int vertex, double old_c, double new_c, vector<CrossingEvent> &events) const {
+      const Watch &w = watches[id];
+      bool up   = old_c <  w.threshold && new_c >= w.threshold;
+      bool down = old_c >= w.threshold && new_c <  w.threshold;
+      if ((up && w.direction != DOWNWARD) || (down && w.direction != UPWARD)){
+        events.push_back(CrossingEvent{id, vertex, old_c, new_c});
+      }
+    }
+
+  public:
+    static const int kAllVertices = INT_MIN;
+
+    CentralityWatches() : num_watches(0) {}
+
+    // Returns the id of the new watch; vertex may be kAllVertices.
+    int Add(int vertex, double threshold, CrossingDirection direction, const CrossingHandler &handler){
+      CHECK(handler);
+      int id = watches.size();
+      watches.push_back(Watch{vertex, threshold, direction, handler});
+      num_watches++;
+      (vertex == kAllVertices ? global_watches : vertex_watches[vertex]).push_back(id);
+      return id;
+    }
+
+    bool Remove(int id){
+      if (id < 0 || (size_t)id >= watches.size() || !watches[id].handler) return false;
+      int vertex = watches[id].vertex;
+      vector<int> &ids = vertex == kAllVertices ? global_watches : vertex_watches[vertex];
+      ids.erase(std::find(ids.begin(), ids.end(), id));
+      if (ids.empty() && vertex != kAllVertices) vertex_watches.erase(vertex);
+      watches[id].handler = nullptr;
+      num_watches--;
+      return true;
+    }
+
+    size_t Size() const { return num_watches; }
+    bool   Empty() const { return num_watches == 0; }
+
+    // Appends the events of the watches that the change of vertex from old_c to new_c crosses.
+    void Check(int vertex, double old_c, double new_c, vector<CrossingEvent> &events) const {
+      if (old_c == new_c) return;
+      for (int id : global_watches) CheckWatch(id, vertex, old_c, new_c, events);
+      auto iter = vertex_watches.find(vertex);
+      if (iter == vertex_watches.end()) return;
+      for (int id : iter->second) CheckWatch(id, vertex, old_c, new_c, events);
+    }
+
+    // Calls the handlers of the events, skipping watches removed by earlier handlers.
+    void Emit(const vector<CrossingEvent> &events) const {
+      for (const auto &e : events){
+        CrossingHandler handler = watches[e.watch_id].handler;
+        if (handler) handler(e);
+      }
+    }
+  };
+}
+
+#endif /* CENTRALITY_WATCH_H */
@@ -2,8 +2,24 @@
 #define DYNAMIC_CENTRALITY_BASE_H
 
 #include "centrality_base.hpp"
+#include <algorithm>
+#include <utility>
 
 namespace betweenness_centrality {
+  // An update operation on a graph. v is ignored for vertex updates.
+  struct Update {
+    enum Type {
+      INSERT_NODE,
+      DELETE_NODE,
+      INSERT_EDGE,
+      DELETE_EDGE,
+    };
+    Type type;
+    int  u;
+    int  v;
+    Update(Type type, int u, int v = -1) : type(type), u(u), v(v) {}
+  };
+  
   class DynamicCentralityBase
     : public CentralityBase { 
   public:
@@ -12,6 +28,49 @@ namespace betweenness_centrality {
     virtual void DeleteNode(int v) = 0;
     virtual void InsertEdge(int u, int v) = 0;
     virtual void DeleteEdge(int u, int v) = 0;
+
+    // The k vertices with the largest centrality, as (vertex, centrality)
+    // in decreasing order of centrality; ties are in no particular order.
+    // This polls every vertex; derived classes keep an index to answer it faster.
+    virtual vector<std::pair<int, double> > TopK(size_t k) const {
+      vector<std::pair<int, double> > res;
+      for (const auto &p : vertex2id) res.emplace_back(p.first, QueryCentrality(p.first));
+      auto cmp = [](const std::pair<int, double> &a, const std::pair<int, double> &b){
+        return a.second > b.second || (a.second == b.second && a.first < b.first);
+      };
+      k = std::min(k, res.size());
+      std::partial_sort(res.begin(), res.begin() + k, res.end(), cmp);
+      res.resize(k);
+      return res;
+    }
+
+    // Rank of v among all vertices by centrality, one plus the number of
+    // vertices with a larger one (so ties share a rank), and the percentage of
+    // vertices whose centrality is at most that of v (100 for the top ones).
+    // Both are 0 for vertices that do not exist. These poll every vertex as well.
+    virtual size_t Rank(int v) const {
+      if (vertex2id.count(v) == 0) return 0;
+      double c   = QueryCentrality(v);
+      size_t res = 1;
+      for (const auto &p : vertex2id) res += QueryCentrality(p.first) > c;
+      return res;
+    }
+    double Percentile(int v) const {
+      size_t r = Rank(v);
+      return r == 0 ? 0.0 : 100.0 * (vertex2id.size() - r + 1) / vertex2id.size();
+    }
+
+    // Applies updates in order. Derived classes may override this to share work among updates.
+    virtual void ApplyBatch(const vector<Update> &updates){
+      for (const auto &upd : updates){
+        switch (upd.type){
+        case Update::INSERT_NODE: InsertNode(upd.u); break;
+        case Update::DELETE_NODE: DeleteNode(upd.u); break;
+        case Update::INSERT_EDGE: InsertEdge(upd.u, upd.v); break;
+        case Update::DELETE_EDGE: DeleteEdge(upd.u, upd.v); break;
+        }
+      }
+    }
   };
 }
 
@@ -182,6 +182,10 @@ namespace betweenness_centrality {
     sources.resize(num_samples);
     targets.resize(num_samples);
     score.resize(V);
+    score_tree.Assign(score);
+    score_rank.Assign(score);
+    id2vertex.resize(V);
+    for (const auto &p : vertex2id) id2vertex[p.snd] = p.fst;
     
     for (int i = 0; i < num_samples; i++){
       sources[i] = rand() % V;
@@ -195,7 +199,7 @@ namespace betweenness_centrality {
       }
 
       for (int v : sp){
-        if (v != sources[i] && v != targets[i]) score[v] += 1.0 / num_samples;
+        if (v != sources[i] && v != targets[i]) AddScore(v, 1.0 / num_samples);
       }
       SPTs.push_back(spt);
       SPs.push_back(sp);
@@ -229,11 +233,11 @@ namespace betweenness_centrality {
         SPTs[i].SampleSP(targets[i], new_sp);
 
         for (int v : SPs[i]){
-          if (v != sources[i] && v != targets[i]) score[v] -= 1.0 / num_samples;
+          if (v != sources[i] && v != targets[i]) AddScore(v, -1.0 / num_samples);
         }
         
         for (int v : new_sp){
-          if (v != sources[i] && v != targets[i]) score[v] += 1.0 / num_samples;
+          if (v != sources[i] && v != targets[i]) AddScore(v, 1.0 / num_samples);
         }
         SPs[i] = new_sp;
       }
@@ -245,6 +249,28 @@ namespace betweenness_centrality {
     BatchInsert(es);
   }
   
+  vector<pair<int, double> > DynamicCentralityBMS::TopK(size_t k) const {
+    score_tree.Flush();
+    vector<int> ids;
+    score_tree.TopK(k, ids);
+    
+    vector<pair<int, double> > res;
+    for (int v : ids) res.emplace_back(id2vertex[v], score[v] * V * V);
+    return res;
+  }
+  
+  size_t DynamicCentralityBMS::Rank(int v) const {
+    if (vertex2id.count(v) == 0) return 0;
+    score_rank.Flush();
+    return score_rank.NumGreater(score[vertex2id.at(v)]) + 1;
+  }
+  
+  void DynamicCentralityBMS::QueryAllCentralities(vector<pair<int, double> > &res) const {
+    res.clear();
+    res.reserve(V);
+    for (size_t v = 0; v < id2vertex.size(); v++) res.emplace_back(id2vertex[v], score[v] * V * V);
+  }
+  
   void DynamicCentralityBMS::Resize(){
     size_t curr_size = score.size();
     while (curr_size++ < V){
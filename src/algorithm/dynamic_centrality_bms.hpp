@@ -3,7 +3,10 @@
 
 #include "common.hpp"
 #include "dynamic_centrality_base.hpp"
+#include "score_rank.hpp"
+#include "score_tree.hpp"
 #include <climits>
+#include <limits>
 #include <cassert>
 #include <algorithm>
 using std::vector;
@@ -52,6 +55,9 @@ namespace betweenness_centrality {
   class DynamicCentralityBMS : public DynamicCentralityBase {
     int num_samples;
     vector<double> score;
+    mutable ScoreTree score_tree; // indices over score for TopK and Rank, flushed lazily by them
+    mutable ScoreRank score_rank;
+    vector<int> id2vertex;
     vector<int> sources;
     vector<int> targets;
     vector<DynamicShortestPathTree> SPTs;
@@ -70,8 +76,16 @@ namespace betweenness_centrality {
     virtual double QueryCentrality(int v) const {
       return vertex2id.count(v) ? score[vertex2id.at(v)] * V * V  : 0;
     }
+    virtual vector<pair<int, double> > TopK(size_t k) const;
+    virtual void QueryAllCentralities(vector<pair<int, double> > &res) const;
+    virtual size_t Rank(int v) const;
   private:
     void Resize();
+    inline void AddScore(int v, double delta){
+      score[v] += delta;
+      score_tree.Set(v, score[v]);
+      score_rank.Set(v, score[v]);
+    }
   };
 }
   
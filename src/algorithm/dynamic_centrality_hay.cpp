@@ -1,11 +1,13 @@
 // #include "dynamic_index.hpp"
 #include "dynamic_centrality_hay.hpp"
+#include "snapshot.hpp"
+#include <unordered_map>
 using namespace std;
 using namespace betweenness_centrality::special_purpose_reachability_index;
 
 namespace betweenness_centrality {
   
-  vector<pair<int, int> > DynamicCentralityHAY::SampleVertexPairs() const {
+  vector<pair<int, int> > DynamicCentralityHAY::SampleVertexPairs(){
     vector<pair<int, int> > res;
     if (debug_mode){
       for (int s = 0; (size_t)s < V; s++){
@@ -15,8 +17,8 @@ namespace betweenness_centrality {
       }
     } else {
       for (int i = 0; i < num_samples; i++){
-        int s = id_manager->SampleAlive();
-        int t = id_manager->SampleAlive();
+        int s = id_manager->SampleAlive(rng);
+        int t = id_manager->SampleAlive(rng);
         res.emplace_back(s, t);
       }
     }
@@ -25,35 +27,235 @@ namespace betweenness_centrality {
 
   // グラフ以外の部分を初期化
   void DynamicCentralityHAY::Init(){
-    spr_index  = new SpecialPurposeReachabilityIndex(&G[0], &G[1], 10);
+    spr_index  = new SpecialPurposeReachabilityIndex(&G[0], &G[1], num_roots, pool, root_selection);
+    spr_index->SetAdaptInterval(root_adapt_interval);
     id_manager = new IDManager(V);
     score      = vector<double>(V, 0);
-    for (int i = 0; i < 2; i++){
-      tmp_dist[i]  = vector<int>(V, -1);
-      tmp_count[i] = vector<double>(V, 0);
+    InitScratch();
+  }
+  
+  void DynamicCentralityHAY::InitScratch(){
+    hyper_edge_index.resize(V);
+    id2vertex.assign(V, -1);
+    is_changed.assign(V, false);
+    old_score.resize(V);
+    old_vertex.resize(V);
+    for (const auto &p : vertex2id) id2vertex[p.snd] = p.fst;
+    score_tree.Assign(score);
+    score_rank.Assign(score);
+    for (size_t v = 0; v < V; v++){
+      if (id2vertex[v] == -1){
+        score_tree.Deactivate(v);
+        score_rank.Deactivate(v);
+      }
+    }
+    workspaces.resize(num_threads);
+    for (size_t i = 0; i < workspaces.size(); i++){
+      workspaces[i].Resize(V);
+      workspaces[i].defer_scores = i > 0;
     }
-    tmp_passable.resize(V, false);
   }
   
   void DynamicCentralityHAY::Clear(){
+    // hyper-edges give their queriers back to spr_index
+    discard_weights = true;
+    for (auto &index : hyper_edges) SafeDelete(index);
+    discard_weights = false;
     SafeDelete(spr_index);
     SafeDelete(id_manager);
+    SafeDelete(update_log);
+    num_updates = 0;
     
-    for (auto &index : hyper_edges) SafeDelete(index);
     G[0].clear();
     G[1].clear();
     score.clear();
+    score_tree.Clear();
+    score_rank.Clear();
+    id2vertex.clear();
+    changed_ids.clear();
+    is_changed.clear();
+    old_score.clear();
+    old_vertex.clear();
     hyper_edges.clear();
-    for (int i = 0; i < 2; i++){
-      tmp_dist[i].clear();
-      tmp_count[i].clear();
+    hyper_edge_index.clear();
+    disconnected_ids.clear();
+    is_listed_disconnected.clear();
+    index_stamp.clear();
+    for (auto &ws : workspaces) ws.Clear();
+  }
+
+  vector<pair<int, double> > DynamicCentralityHAY::TopK(size_t k) const {
+    score_tree.Flush();
+    vector<int> ids;
+    score_tree.TopK(k, ids);
+    
+    vector<pair<int, double> > res;
+    size_t num_vs = vertex2id.size();
+    for (int v : ids) res.emplace_back(id2vertex[v], score[v] / hyper_edges.size() * num_vs * num_vs);
+    return res;
+  }
+
+  void DynamicCentralityHAY::QueryAllCentralities(vector<pair<int, double> > &res) const {
+    res.clear();
+    res.reserve(vertex2id.size());
+    size_t num_vs = vertex2id.size();
+    for (size_t v = 0; v < id2vertex.size(); v++){
+      if (id2vertex[v] != -1) res.emplace_back(id2vertex[v], score[v] / hyper_edges.size() * num_vs * num_vs);
+    }
+  }
+
+  size_t DynamicCentralityHAY::Rank(int v) const {
+    if (!ValidNode(v)) return 0;
+    score_rank.Flush();
+    return score_rank.NumGreater(score[vertex2id.at(v)]) + 1;
+  }
+
+  size_t DynamicCentralityHAY::GetNumDisconnectedPairs() const {
+    size_t res = 0;
+    for (const auto e : hyper_edges){
+      if (e->GetSource() != e->GetTarget() && !e->IsConnected()) res++;
+    }
+    return res;
+  }
+
+  vector<pair<int, int> > DynamicCentralityHAY::GetSampledPairs() const {
+    vector<pair<int, int> > res;
+    res.reserve(hyper_edges.size());
+    for (const auto e : hyper_edges){
+      res.emplace_back(id2vertex[e->GetSource()], id2vertex[e->GetTarget()]);
+    }
+    return res;
+  }
+
+  void DynamicCentralityHAY::SetReachabilityRoots(int x, RootSelection selection){
+    CHECK(x >= 1);
+    num_roots      = x;
+    root_selection = selection;
+  }
+  
+  void DynamicCentralityHAY::SetRootAdaptInterval(uint64_t interval){
+    root_adapt_interval = interval;
+    if (spr_index != nullptr) spr_index->SetAdaptInterval(interval);
+  }
+
+  void DynamicCentralityHAY::SetNumThreads(int x){
+    CHECK(x >= 1);
+    num_threads = x;
+    SafeDelete(pool);
+    if (num_threads > 1){
+      pool = new ThreadPool(num_threads);
+    }
+    if (spr_index != nullptr) spr_index->SetThreadPool(pool);
+    
+    size_t curr_size = workspaces.size();
+    workspaces.resize(num_threads);
+    for (size_t i = 0; i < workspaces.size(); i++){
+      if (i >= curr_size && !G[0].empty()) workspaces[i].Resize(G[0].size());
+      workspaces[i].defer_scores = i > 0;
+    }
+  }
+
+  void DynamicCentralityHAY::ParallelFor(size_t n, const function<void(Workspace &, size_t)> &f){
+    if (pool == nullptr){
+      for (size_t i = 0; i < n; i++) f(workspaces[0], i);
+    } else {
+      pool->ParallelFor(n, [&](int w, size_t i){ f(workspaces[w], i); });
+    }
+  }
+
+  void DynamicCentralityHAY::ForEachHyperEdge(const function<void(HyperEdge *, Workspace &)> &f, const vector<int> *ids){
+    size_t n = ids != nullptr ? ids->size() : hyper_edges.size();
+    ParallelFor(n, [&](Workspace &ws, size_t i){
+        f(hyper_edges[ids != nullptr ? (*ids)[i] : i], ws);
+      });
+    MergeWorkspaces();
+  }
+
+  void DynamicCentralityHAY::MergeWorkspaces(){
+    is_listed_disconnected.resize(hyper_edges.size(), false);
+    for (auto &ws : workspaces){
+      for (const auto &p : ws.score_deltas){
+        AddScore(p.fst, p.snd);
+      }
+      for (const auto &p : ws.index_log){
+        hyper_edge_index[p.fst].push_back(p.snd);
+      }
+      for (int id : ws.disconnected_log){
+        if (!is_listed_disconnected[id]){
+          is_listed_disconnected[id] = true;
+          disconnected_ids.push_back(id);
+        }
+      }
+      ws.score_deltas.clear();
+      ws.index_log.clear();
+      ws.disconnected_log.clear();
     }
-    tmp_passable.clear();
+  }
+
+  // Drops duplicated entries and hyper-edges that no longer contain v.
+  void DynamicCentralityHAY::CompactHyperEdgeIndex(int v){
+    index_stamp.resize(hyper_edges.size(), 0);
+    if (++curr_stamp == std::numeric_limits<int>::max()){
+      fill(index_stamp.begin(), index_stamp.end(), 0);
+      curr_stamp = 1;
+    }
+    
+    auto  &ids = hyper_edge_index[v];
+    size_t m   = 0;
+    for (int id : ids){
+      if ((size_t)id >= hyper_edges.size() || index_stamp[id] == curr_stamp) continue;
+      index_stamp[id] = curr_stamp;
+      if (hyper_edges[id]->HasNode(v)){
+        ids[m++] = id;
+      } else {
+        hyper_edges[id]->UnindexNode(v);
+      }
+    }
+    ids.resize(m);
+  }
+
+  void DynamicCentralityHAY::CollectDisconnectedHyperEdges(vector<int> &ids){
+    size_t m = 0;
+    for (int id : disconnected_ids){
+      const HyperEdge *e = hyper_edges[id];
+      if (!e->IsConnected() && e->GetSource() != e->GetTarget()){
+        disconnected_ids[m++] = id;
+        ids.push_back(id);
+      } else {
+        is_listed_disconnected[id] = false;
+      }
+    }
+    disconnected_ids.resize(m);
+  }
+
+  void DynamicCentralityHAY::RebuildHyperEdgeIndex(){
+    for (auto &ws : workspaces){
+      ws.index_log.clear();
+      ws.disconnected_log.clear();
+    }
+    for (auto &ids : hyper_edge_index) ids.clear();
+    disconnected_ids.clear();
+    is_listed_disconnected.assign(hyper_edges.size(), false);
+    for (size_t i = 0; i < hyper_edges.size(); i++){
+      hyper_edges[i]->Reindex(i, workspaces[0]);
+    }
+    MergeWorkspaces();
   }
   
   void DynamicCentralityHAY::
   PreCompute(const vector<pair<int, int> > &es, int num_samples_){    
     Clear();
+    BuildGraph(es);
+    BuildIndex(num_samples_);
+  }
+  
+  void DynamicCentralityHAY::PreCompute(const MappedGraph &graph, int num_samples_){
+    Clear();
+    BuildGraph(graph);
+    BuildIndex(num_samples_);
+  }
+  
+  void DynamicCentralityHAY::BuildIndex(int num_samples_){
     this->num_samples = num_samples_;
     if (num_samples == -1){
       debug_mode = true;
@@ -61,13 +263,195 @@ namespace betweenness_centrality {
       debug_mode = false;
     }
     
-    BuildGraph(es);
+    rng.Seed(uint64_t(rand()) << 31 | rand());
     Init();
     
+    // Hyper-edges are built on all threads, and their weights are added
+    // afterwards in the order of their ids, as a serial build would do.
     auto vertex_pairs = SampleVertexPairs();
-    for (const auto &vp : vertex_pairs){
-      hyper_edges.push_back(new HyperEdge(vp.fst, vp.snd, this));
+    hyper_edges.assign(vertex_pairs.size(), nullptr);
+    for (auto &ws : workspaces) ws.skip_scores = true;
+    ParallelFor(vertex_pairs.size(), [&](Workspace &ws, size_t i){
+        hyper_edges[i] = new HyperEdge(vertex_pairs[i].fst, vertex_pairs[i].snd, i, this, ws);
+      });
+    for (auto &ws : workspaces) ws.skip_scores = false;
+    
+    for (auto e : hyper_edges) e->AddWeight(workspaces[0]);
+    MergeWorkspaces();
+  }
+
+  bool DynamicCentralityHAY::Save(const string &path) const {
+    SnapshotWriter out(path);
+    out.Put<uint64_t>(V);
+    out.Put<uint64_t>(E);
+    for (int i = 0; i < 2; i++){
+      for (const auto &adj : G[i]) out.PutVector(adj);
     }
+    out.PutVector(vector<pair<int, int> >(vertex2id.begin(), vertex2id.end()));
+    out.Put<char>(debug_mode);
+    out.Put(num_samples);
+    out.Put(tradeoff_param);
+    out.Put(num_updates);
+    out.Put(rng.GetState());
+    out.PutVector(score);
+    id_manager->Save(out);
+    spr_index->Save(out);
+    
+    unordered_map<const ReachabilityQuerier*, int> querier_ids;
+    const auto &queriers = spr_index->GetQueriers();
+    for (size_t i = 0; i < queriers.size(); i++) querier_ids[queriers[i]] = i;
+    out.Put<uint64_t>(hyper_edges.size());
+    for (const auto e : hyper_edges){
+      auto iter = e->GetQuerier() != nullptr ? querier_ids.find(e->GetQuerier()) : querier_ids.end();
+      e->Save(out, iter != querier_ids.end() ? iter->second : -1);
+    }
+    return out.Close();
+  }
+
+  bool DynamicCentralityHAY::Load(const string &path){
+    Clear();
+    SnapshotReader in(path);
+    if (in.Failed()) return false;
+    
+    V = in.Get<uint64_t>();
+    E = in.Get<uint64_t>();
+    for (int i = 0; i < 2 && !in.Failed(); i++){
+      G[i].resize(V);
+      for (auto &adj : G[i]) in.GetVector(adj);
+    }
+    vector<pair<int, int> > ids;
+    in.GetVector(ids);
+    vertex2id.clear();
+    vertex2id.insert(ids.begin(), ids.end());
+    debug_mode     = in.Get<char>();
+    num_samples    = in.Get<int>();
+    tradeoff_param = in.Get<int>();
+    num_updates    = in.Get<uint64_t>();
+    rng.SetState(in.Get<uint64_t>());
+    in.GetVector(score);
+    id_manager = new IDManager(0);
+    id_manager->Load(in);
+    spr_index  = new SpecialPurposeReachabilityIndex(&G[0], &G[1], in, pool);
+    spr_index->SetAdaptInterval(root_adapt_interval);
+    
+    // hyper-edges subtract their weights from score when deleted
+    size_t num_hyper_edges = in.Get<uint64_t>();
+    for (size_t i = 0; i < num_hyper_edges && !in.Failed() && score.size() == V; i++){
+      hyper_edges.push_back(new HyperEdge(in, i, this));
+    }
+    if (in.Failed() || !in.AtEnd() || score.size() != V){
+      Clear();
+      return false;
+    }
+    
+    InitScratch();
+    RebuildHyperEdgeIndex();
+    return true;
+  }
+
+  DynamicCentralityHAY::UpdateScope::UpdateScope(DynamicCentralityHAY *dch, const vector<Update> &updates, bool batch)
+    : dch(dch)
+  {
+    if (dch->update_depth++ > 0) return;
+    dch->num_updates++;
+    dch->old_num_vs          = dch->vertex2id.size();
+    dch->old_num_hyper_edges = dch->hyper_edges.size();
+    if (dch->update_log != nullptr){
+      UpdateLogRecord rec;
+      rec.seq          = dch->num_updates;
+      rec.rng_state[0] = dch->rng.GetState();
+      rec.rng_state[1] = dch->spr_index->GetRandom().GetState();
+      rec.batch        = batch;
+      rec.updates      = updates;
+      // an update must not be applied unless it can be replayed
+      CHECK(dch->update_log->Append(rec));
+    }
+  }
+
+  void DynamicCentralityHAY::EmitCrossings(){
+    size_t num_vs = vertex2id.size();
+    vector<CrossingEvent> events;
+    auto check = [&](int v){
+      int    prev_vertex = is_changed[v] ? old_vertex[v] : id2vertex[v];
+      double prev_score  = is_changed[v] ? old_score[v]  : score[v];
+      double prev_c = prev_vertex == -1 ? 0.0 : prev_score / old_num_hyper_edges * old_num_vs * old_num_vs;
+      double curr_c = id2vertex[v] == -1 ? 0.0 : score[v] / hyper_edges.size() * num_vs * num_vs;
+      if (prev_vertex == id2vertex[v]){
+        if (prev_vertex != -1) watches.Check(prev_vertex, prev_c, curr_c, events);
+      } else {
+        if (prev_vertex  != -1) watches.Check(prev_vertex, prev_c, 0.0, events);
+        if (id2vertex[v] != -1) watches.Check(id2vertex[v], 0.0, curr_c, events);
+      }
+    };
+    if (!watches.Empty()){
+      if (num_vs != old_num_vs || hyper_edges.size() != old_num_hyper_edges){
+        for (size_t v = 0; v < id2vertex.size(); v++) check(v);
+      } else {
+        for (int v : changed_ids) check(v);
+      }
+    }
+    for (int v : changed_ids) is_changed[v] = false;
+    changed_ids.clear();
+    
+    // handlers run once the update is over, as they may apply updates of their own
+    watches.Emit(events);
+  }
+
+  bool DynamicCentralityHAY::OpenUpdateLog(const string &path, bool sync){
+    SafeDelete(update_log);
+    UpdateLogReader reader(path);
+    UpdateLogRecord rec;
+    uint64_t last_seq = num_updates;
+    while (reader.Next(rec)) last_seq = rec.seq;
+    if (reader.Failed() || last_seq != num_updates) return false;
+    
+    update_log = new UpdateLogWriter(path, reader.ValidSize(), sync);
+    if (update_log->Failed()){
+      SafeDelete(update_log);
+      return false;
+    }
+    return true;
+  }
+
+  bool DynamicCentralityHAY::Checkpoint(const string &path){
+    // the old checkpoint stays valid until the new one is complete
+    string temp_path = path + ".tmp";
+    if (!Save(temp_path) || rename(temp_path.c_str(), path.c_str()) != 0) return false;
+    return update_log == nullptr || update_log->Truncate();
+  }
+
+  bool DynamicCentralityHAY::Recover(const string &checkpoint_path, const string &log_path, bool sync){
+    if (!Load(checkpoint_path)) return false;
+    
+    // Records up to the checkpoint are left if the process died between saving it and emptying the log.
+    UpdateLogReader reader(log_path);
+    UpdateLogRecord rec;
+    bool has_gap = false;
+    while (reader.Next(rec)){
+      if (rec.seq <= num_updates) continue;
+      if (rec.seq != num_updates + 1){
+        has_gap = true;
+        break;
+      }
+      rng.SetState(rec.rng_state[0]);
+      spr_index->GetRandom().SetState(rec.rng_state[1]);
+      if (rec.batch){
+        ApplyBatch(rec.updates);
+      } else {
+        DynamicCentralityBase::ApplyBatch(rec.updates);
+      }
+    }
+    if (reader.Failed() || has_gap){
+      Clear();
+      return false;
+    }
+    
+    update_log = new UpdateLogWriter(log_path, reader.ValidSize(), sync);
+    if (update_log->Failed()){
+      SafeDelete(update_log);
+      return false;
+    }
+    return true;
   }
 
   // 辺 {s, t}がすでにあった場合は何もせずfalseをかえす
@@ -111,7 +495,7 @@ namespace betweenness_centrality {
         V++;
       }
       CHECK(id_manager->Size() == V);
-      vertex2id[v] = id_manager->SampleDead();
+      vertex2id[v] = id_manager->SampleDead(rng);
       CHECK(vertex2id.size() == V);
       id_manager->MakeAlive(vertex2id[v]);
 
@@ -119,12 +503,19 @@ namespace betweenness_centrality {
         G[0].push_back(vector<int>());
         G[1].push_back(vector<int>());
         score.push_back(0);
-        for (int i = 0; i < 2; i++){
-          tmp_dist[i].push_back(-1);
-          tmp_count[i].push_back(0);
-        }
-        tmp_passable.push_back(false);
+        hyper_edge_index.push_back(vector<int>());
+        id2vertex.push_back(-1);
+        is_changed.push_back(false);
+        old_score.push_back(0);
+        old_vertex.push_back(-1);
       }
+      score_tree.Resize(V);
+      score_rank.Resize(V);
+      TouchScore(vertex2id[v]);
+      id2vertex[vertex2id[v]] = v;
+      score_tree.Set(vertex2id[v], score[vertex2id[v]]);
+      score_rank.Set(vertex2id[v], score[vertex2id[v]]);
+      for (auto &ws : workspaces) ws.Resize(G[0].size());
       CHECK(G[0].size() == V);
       return true;
     }
@@ -154,29 +545,145 @@ namespace betweenness_centrality {
 
   void DynamicCentralityHAY::InsertEdge(int s, int t){
     CHECK(vertex2id.count(s) && vertex2id.count(t));
+    UpdateScope scope(this, {Update(Update::INSERT_EDGE, s, t)}, false);
     s = vertex2id[s];
     t = vertex2id[t];
     if (InsertEdgeIntoGraph(s, t)){
       spr_index->InsertEdge(s, t);
-      for (auto e : hyper_edges){
-        e->InsertEdge(s, t);
+      auto f = [&](HyperEdge *e, Workspace &ws){ e->InsertEdge(s, t, ws); };
+      
+      if (tradeoff_param > 0){
+        // UpdateDAGbyInsertion3 may find new shortest paths through (s, t)
+        // even if neither s nor t is in any ball, so visit every hyper-edge.
+        ForEachHyperEdge(f);
+      } else {
+        // A connected hyper-edge is affected only if s is in ball_s or t is in ball_t.
+        vector<int> ids;
+        for (int v : {s, t}){
+          CompactHyperEdgeIndex(v);
+          ids.insert(ids.end(), hyper_edge_index[v].begin(), hyper_edge_index[v].end());
+        }
+        CollectDisconnectedHyperEdges(ids);
+        sort(ids.begin(), ids.end());
+        ids.erase(unique(ids.begin(), ids.end()), ids.end());
+        ForEachHyperEdge(f, &ids);
       }
     }
   }
 
   void DynamicCentralityHAY::DeleteEdge(int s, int t){
     CHECK(vertex2id.count(s) && vertex2id.count(t));
+    UpdateScope scope(this, {Update(Update::DELETE_EDGE, s, t)}, false);
     s = vertex2id[s];
     t = vertex2id[t];
     if (DeleteEdgeFromGraph(s, t)){
       spr_index->DeleteEdge(s, t);
-      for (auto &e : hyper_edges){
-        e->DeleteEdge(s, t);
+      // A hyper-edge is affected only if both s and t are in one of its balls or in its DAG.
+      int v = hyper_edge_index[s].size() <= hyper_edge_index[t].size() ? s : t;
+      CompactHyperEdgeIndex(v);
+      vector<int> ids(hyper_edge_index[v]);
+      ForEachHyperEdge([&](HyperEdge *e, Workspace &ws){
+          e->DeleteEdge(s, t, ws);
+        }, &ids);
+    }
+  }
+  
+  void DynamicCentralityHAY::ApplyBatch(const vector<Update> &updates){
+    UpdateScope scope(this, updates, true);
+    if (tradeoff_param > 0){
+      // Affected hyper-edges cannot be told from their balls alone (see InsertEdge).
+      DynamicCentralityBase::ApplyBatch(updates);
+      return;
+    }
+    
+    vector<Update> edge_updates;
+    for (const auto &upd : updates){
+      if (upd.type == Update::INSERT_EDGE || upd.type == Update::DELETE_EDGE){
+        CHECK(vertex2id.count(upd.u) && vertex2id.count(upd.v));
+        int s = vertex2id[upd.u];
+        int t = vertex2id[upd.v];
+        if (upd.type == Update::INSERT_EDGE && InsertEdgeIntoGraph(s, t)){
+          spr_index->InsertEdge(s, t);
+          edge_updates.emplace_back(upd.type, s, t);
+        } else if (upd.type == Update::DELETE_EDGE && DeleteEdgeFromGraph(s, t)){
+          spr_index->DeleteEdge(s, t);
+          edge_updates.emplace_back(upd.type, s, t);
+        }
+      } else {
+        RepairHyperEdges(edge_updates);
+        edge_updates.clear();
+        if (upd.type == Update::INSERT_NODE){
+          InsertNode(upd.u);
+        } else {
+          DeleteNode(upd.u);
+        }
+      }
+    }
+    RepairHyperEdges(edge_updates);
+  }
+
+  void DynamicCentralityHAY::RepairHyperEdges(const vector<Update> &edge_updates){
+    if (edge_updates.empty()) return;
+
+    // Hyper-edges are judged by their balls and DAG from before the batch,
+    // which have not been touched while the graph was updated. Each one is
+    // then repaired with the updates that reach it: (id, position in edge_updates).
+    vector<pair<int, int> > hits;
+    bool has_insertion = false;
+    for (size_t i = 0; i < edge_updates.size(); i++){
+      const auto &upd = edge_updates[i];
+      bool insertion = upd.type == Update::INSERT_EDGE;
+      // an edge inserted and deleted again in the batch is not in the graph
+      if (insertion && !binary_search(G[0][upd.u].begin(), G[0][upd.u].end(), upd.v)) continue;
+      has_insertion |= insertion;
+      for (int v : {upd.u, upd.v}){
+        CompactHyperEdgeIndex(v);
+        for (int id : hyper_edge_index[v]){
+          const HyperEdge *e = hyper_edges[id];
+          if (insertion ? e->AffectedByInsertion(upd.u, upd.v) : e->AffectedByDeletion(upd.u, upd.v)){
+            hits.emplace_back(id, i);
+          }
+        }
       }
     }
+    
+    if (has_insertion){
+      vector<int> disconnected;
+      CollectDisconnectedHyperEdges(disconnected);
+      for (int id : disconnected){
+        if (hyper_edges[id]->CanReconnect()) hits.emplace_back(id, -1);
+      }
+    }
+    sort(hits.begin(), hits.end());
+    hits.erase(unique(hits.begin(), hits.end()), hits.end());
+    
+    vector<int>    ids;
+    vector<size_t> begin;
+    for (size_t k = 0; k < hits.size(); k++){
+      if (k == 0 || hits[k].fst != hits[k - 1].fst){
+        ids.push_back(hits[k].fst);
+        begin.push_back(k);
+      }
+    }
+    begin.push_back(hits.size());
+    
+    ParallelFor(ids.size(), [&](Workspace &ws, size_t i){
+        auto &deleted  = ws.batch_edges[0];
+        auto &inserted = ws.batch_edges[1];
+        deleted.clear();
+        inserted.clear();
+        for (size_t k = begin[i]; k < begin[i + 1]; k++){
+          if (hits[k].snd == -1) continue;
+          const auto &upd = edge_updates[hits[k].snd];
+          (upd.type == Update::INSERT_EDGE ? inserted : deleted).emplace_back(upd.u, upd.v);
+        }
+        hyper_edges[ids[i]]->Repair(deleted, inserted, ws);
+      });
+    MergeWorkspaces();
   }
   
   void DynamicCentralityHAY::InsertNode(int u){
+    UpdateScope scope(this, {Update(Update::INSERT_NODE, u)}, false);
     if (InsertNodeIntoGraph(u) && ValidNode(u)){
       u = vertex2id[u];
       spr_index->InsertNode(u);
@@ -185,7 +692,7 @@ namespace betweenness_centrality {
         for (int s = 0; size_t(s) < V; s++)
           for (int t = 0; size_t(t) < V; t++)
             if ((s == u && ValidNode(t)) || (ValidNode(s) && t == u))
-              hyper_edges.push_back(new HyperEdge(s, t, this));
+              hyper_edges.push_back(new HyperEdge(s, t, hyper_edges.size(), this, workspaces[0]));
       } else {
         size_t n     = vertex2id.size();
         CHECK(n > 0);
@@ -195,7 +702,7 @@ namespace betweenness_centrality {
         for (auto &e : hyper_edges){
           int new_source = -1;
           int new_target = -1;
-          double q = (double)rand() / RAND_MAX;
+          double q = rng.UniformReal();
           if (q < prob1){ // no change
             continue;
           } else if (q < prob2 + prob1){
@@ -204,24 +711,27 @@ namespace betweenness_centrality {
             new_source = new_target = u;
             CHECK(n > 1u);
             while (new_target == u){
-              new_target = id_manager->SampleAlive();
+              new_target = id_manager->SampleAlive(rng);
             }
             
-            if (((double)rand() / RAND_MAX) < 0.5){
+            if (rng.UniformReal() < 0.5){
               swap(new_source, new_target);
             }
           }
+          int id = &e - &hyper_edges[0];
           SafeDelete(e);
-          e = new HyperEdge(new_source, new_target, this);
+          e = new HyperEdge(new_source, new_target, id, this, workspaces[0]);
         }
       }
       for (auto e : hyper_edges){
         e->InsertNode(u);
       }
+      MergeWorkspaces();
     }
   }
   
   void DynamicCentralityHAY::DeleteNode(int u){
+    UpdateScope scope(this, {Update(Update::DELETE_NODE, u)}, false);
     if (vertex2id.count(u) == 0){
       return;
     }
@@ -242,27 +752,34 @@ namespace betweenness_centrality {
           if (e->GetSource() == v || e->GetTarget() == v) {
             SafeDelete(e);
           } else {
-            e->DeleteNode(v, v_out, v_in);
+            e->DeleteNode(v, v_out, v_in, workspaces[0]);
             new_hs.push_back(e);
           }
         }
         hyper_edges = new_hs;
+        RebuildHyperEdgeIndex();
         
       } else {
         for (auto &e : hyper_edges){
           if (e->GetSource() == v || e->GetTarget() == v){
-            int new_source = id_manager->SampleAlive();
-            int new_target = id_manager->SampleAlive();
+            int new_source = id_manager->SampleAlive(rng);
+            int new_target = id_manager->SampleAlive(rng);
             CHECK(new_target != v && new_source != v);
+            int id = &e - &hyper_edges[0];
             SafeDelete(e);
-            e = new HyperEdge(new_source, new_target, this);
+            e = new HyperEdge(new_source, new_target, id, this, workspaces[0]);
           } else {
-            e->DeleteNode(v, v_out, v_in);
+            e->DeleteNode(v, v_out, v_in, workspaces[0]);
           }
         }
+        MergeWorkspaces();
       }
       CHECK(score[v] < 1e-9);
     }
+    TouchScore(v);
+    id2vertex[v] = -1;
+    score_tree.Deactivate(v);
+    score_rank.Deactivate(v);
   }
 
 } /* betweenness_centrality */
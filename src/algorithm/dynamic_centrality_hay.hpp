@@ -2,12 +2,20 @@
 #define DYNAMIC_CENTRALITY_HAY_H
 
 #include "common.hpp"
+#include "centrality_watch.hpp"
 #include "dynamic_centrality_base.hpp"
 #include "hyper_edge.hpp"
 #include "special_purpose_reachability_index.hpp"
+#include "thread_pool.hpp"
+#include "random.hpp"
+#include "score_rank.hpp"
+#include "score_tree.hpp"
+#include "update_log.hpp"
 #include <vector>
+#include <functional>
 #include <cstdlib>
 #include <queue>
+#include <string>
 using std::vector;
 using std::pair;
 
@@ -20,46 +28,195 @@ namespace betweenness_centrality {
     int tradeoff_param;
     vector<double>     score;
     vector<HyperEdge*> hyper_edges;
+    // Set while Clear deletes the hyper-edges: score goes away with them, so
+    // they do not subtract their weights, which they could not do after a
+    // failed Load, as the score structures are not built yet.
+    bool               discard_weights;
+    
+    // Indices over score for TopK and Rank, flushed lazily by them, and the vertex of each id (-1 if dead).
+    mutable ScoreTree score_tree;
+    mutable ScoreRank score_rank;
+    vector<int>       id2vertex;
+    
+    // Threshold watches (see AddWatch), and the previous scores and vertices
+    // of the ids whose scores changed in the current update, while there are watches.
+    CentralityWatches watches;
+    vector<int>       changed_ids;
+    vector<char>      is_changed;
+    vector<double>    old_score;
+    vector<int>       old_vertex;
+    size_t            old_num_vs;
+    size_t            old_num_hyper_edges;
+    
+    // Inverted index from each vertex to the hyper-edges whose balls or DAG may contain it.
+    // Entries are added when a hyper-edge gains the vertex and dropped lazily once stale.
+    vector<vector<int> > hyper_edge_index;
+    // Hyper-edges that may be disconnected. They need a reachability check on insertion.
+    vector<int>  disconnected_ids;
+    vector<char> is_listed_disconnected;
+    vector<int>  index_stamp;
+    int          curr_stamp;
 
     // maintain ids that are assigned to each vertex.
     IDManager *id_manager;
+    // samples vertices; seeded from rand() in PreCompute
+    Random rng;
+    
+    // Updates (or batches) applied since PreCompute, and the log they are written to (see OpenUpdateLog).
+    uint64_t         num_updates;
+    int              update_depth;
+    UpdateLogWriter *update_log;
+    
+    // temporal variables for index construction, one set per thread.
+    // workspaces[0] belongs to the calling thread and writes score directly.
+    vector<Workspace> workspaces;
     
-    // temporal variables for index construction
-    vector<int>    tmp_dist[2];
-    vector<double> tmp_count[2];
-    vector<int>    tmp_passable;
+    // workers for parallel hyper-edge updates (nullptr while num_threads == 1)
+    int         num_threads;
+    ThreadPool *pool;
     
     // keep disjoint set union of nodes
     special_purpose_reachability_index::SpecialPurposeReachabilityIndex *spr_index;
+    int                                               num_roots;
+    special_purpose_reachability_index::RootSelection root_selection;
+    uint64_t                                          root_adapt_interval;
     
     void Init();  // Initialize the arrays
+    void InitScratch(); // Initialize the arrays that are not part of a snapshot
     void Clear(); // Delete the array
-    int SampleVertex() const ;
-    vector<pair<int, int> > SampleVertexPairs() const ;
+    void BuildIndex(int num_samples); // Samples pairs and builds everything but the graph
+    vector<pair<int, int> > SampleVertexPairs();
     
     bool InsertEdgeIntoGraph(int s, int t);
     bool DeleteEdgeFromGraph(int s, int t);
     bool InsertNodeIntoGraph(int v);
     bool DeleteNodeFromGraph(int v);
     inline bool ValidNode(int v) const { return vertex2id.count(v); }
+    inline void TouchScore(int v){
+      if (update_depth > 0 && !watches.Empty() && !is_changed[v]){
+        is_changed[v] = true;
+        changed_ids.push_back(v);
+        old_score[v]  = score[v];
+        old_vertex[v] = id2vertex[v];
+      }
+    }
+    inline void AddScore(int v, double delta){
+      TouchScore(v);
+      score[v] += delta;
+      if (score_tree.IsActive(v)){
+        score_tree.Set(v, score[v]);
+        score_rank.Set(v, score[v]);
+      }
+    }
+    
+    // Calls f(ws, i) for every i in [0, n), spreading the calls over the thread
+    // pool if any. ws is the workspace of the thread that makes the call.
+    void ParallelFor(size_t n, const std::function<void(Workspace &, size_t)> &f);
+    // Calls f on the hyper-edges in ids (or on all of them if ids is nullptr),
+    // spreading them over the thread pool if any.
+    void ForEachHyperEdge(const std::function<void(HyperEdge *, Workspace &)> &f, const vector<int> *ids = nullptr);
+    void MergeWorkspaces();
+    
+    void CompactHyperEdgeIndex(int v);
+    void CollectDisconnectedHyperEdges(vector<int> &ids);
+    void RebuildHyperEdgeIndex();
+    
+    // Repairs every hyper-edge affected by edge updates that were already applied to the graph.
+    void RepairHyperEdges(const vector<Update> &edge_updates);
+    
+    // Passes the threshold crossings of the update that just ended to the watches.
+    void EmitCrossings();
+    
+    // Counts an update and writes it to the update log, if it is not made
+    // while applying another update (as ApplyBatch does).
+    class UpdateScope {
+    private:
+      DynamicCentralityHAY *dch;
+    public:
+      UpdateScope(DynamicCentralityHAY *dch, const vector<Update> &updates, bool batch);
+      ~UpdateScope(){ if (--dch->update_depth == 0) dch->EmitCrossings(); }
+    };
     
   public:
-    DynamicCentralityHAY() : debug_mode(false), tradeoff_param(0), id_manager(nullptr), spr_index(nullptr) { }
-    ~DynamicCentralityHAY(){ Clear(); }
+    DynamicCentralityHAY() : debug_mode(false), tradeoff_param(0), discard_weights(false), old_num_vs(0), old_num_hyper_edges(0), curr_stamp(0), id_manager(nullptr), num_updates(0), update_depth(0), update_log(nullptr), num_threads(1), pool(nullptr), spr_index(nullptr), num_roots(10), root_selection(special_purpose_reachability_index::RANDOM_ROOTS), root_adapt_interval(0) { }
+    ~DynamicCentralityHAY(){ Clear(); SafeDelete(pool); }
     
     virtual void PreCompute(const vector<pair<int, int> > &es, int num_samples);
+    virtual void PreCompute(const MappedGraph &graph, int num_samples);
     
     virtual double QueryCentrality(int v) const {
       size_t num_vs = vertex2id.size();
       return ValidNode(v) ? score[vertex2id.at(v)] / hyper_edges.size() * num_vs * num_vs : 0.0;
     }
+    // O(k log n), plus the scores changed since the last call.
+    virtual vector<pair<int, double> > TopK(size_t k) const;
+    // One pass over the scores, in the order of internal ids.
+    virtual void QueryAllCentralities(vector<pair<int, double> > &res) const;
+    // O(log n), plus the scores changed since the last call.
+    virtual size_t Rank(int v) const;
     
     virtual void InsertEdge(int s, int t);
     virtual void DeleteEdge(int s, int t);
     virtual void InsertNode(int v);
     virtual void DeleteNode(int v);
     
+    // Writes the whole index (graph, samples, hyper-edges and reachability index)
+    // to a binary snapshot, and reads it back instead of calling PreCompute.
+    // Load returns false, leaving the index empty, if the file is missing or
+    // is not a valid snapshot of this version. The thread settings are not saved.
+    bool Save(const std::string &path) const;
+    bool Load(const std::string &path);
+    
+    // Write-ahead log for crash recovery. Once a log is open, every update or
+    // batch is appended to it, with the states of the random generators,
+    // before it is applied. Checkpoint saves a snapshot and then empties the
+    // log, and Recover loads the snapshot and replays the updates logged after
+    // it, which gives the same index as before the crash.
+    // OpenUpdateLog fails if the log holds updates that are not in the index.
+    // PreCompute, Load and Recover close the log; Recover opens log_path again
+    // afterwards, without the record that was being written at the crash, if any.
+    bool OpenUpdateLog(const std::string &path, bool sync = false);
+    bool Checkpoint(const std::string &path);
+    bool Recover(const std::string &checkpoint_path, const std::string &log_path, bool sync = false);
+    uint64_t GetNumUpdates() const { return num_updates; }
+    
+    // Sampled pairs (s != t) that are disconnected, and the queriers of the
+    // reachability index, which only such pairs hold; the two are equal between updates.
+    size_t GetNumDisconnectedPairs() const;
+    size_t GetNumQueriers() const { return spr_index != nullptr ? spr_index->GetQueriers().size() : 0; }
+    // The sampled pairs of vertices, one for each hyper-edge in the order of their ids.
+    vector<pair<int, int> > GetSampledPairs() const;
+    
+    // Calls handler after each update or batch (including those replayed by
+    // Recover) that moves the centrality of vertex, or of any vertex for
+    // CentralityWatches::kAllVertices, across threshold in the given
+    // direction. Vertices that do not exist have centrality 0. Only the
+    // vertices whose scores changed are checked, except after vertex updates,
+    // which rescale every centrality. Watches are kept across PreCompute and
+    // Load; handlers may query and update the index.
+    int  AddWatch(int vertex, double threshold, CrossingDirection direction, const CrossingHandler &handler){
+      return watches.Add(vertex, threshold, direction, handler);
+    }
+    bool RemoveWatch(int id){ return watches.Remove(id); }
+    
+    // Applies all edge updates between two vertex updates to the graph first,
+    // and then repairs each affected hyper-edge once.
+    virtual void ApplyBatch(const vector<Update> &updates);
+    
     void SetTradeOffParam(int x) { tradeoff_param = x;}
+    
+    // Roots of the reachability index, which answers whether disconnected
+    // pairs have become connected. num_roots and selection take effect at
+    // the next PreCompute; the adapt interval (see
+    // SpecialPurposeReachabilityIndex::SetAdaptInterval, 0 to keep the roots)
+    // also applies to the current index and to loaded ones.
+    void SetReachabilityRoots(int num_roots, special_purpose_reachability_index::RootSelection selection);
+    void SetRootAdaptInterval(uint64_t interval);
+    
+    // Number of threads used to build hyper-edges in PreCompute, and to update them and the
+    // trees and queriers of the reachability index in InsertEdge/DeleteEdge/DeleteNode.
+    void SetNumThreads(int x);
+    int  GetNumThreads() const { return num_threads; }
     friend class HyperEdge;
   };
 };
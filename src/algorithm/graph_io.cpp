@@ -0,0 +1,236 @@
+#include "graph_io.hpp"
+#include "common.hpp"
+#include <algorithm>
+#include <climits>
+#include <thread>
+#include <unordered_map>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+using namespace std;
+
+namespace betweenness_centrality {
+
+  namespace {
+    const char     kMagic[8] = {'H', 'A', 'Y', 'G', 'R', 'A', 'P', 'H'};
+    const uint32_t kVersion  = 1;
+
+    struct Header {
+      char     magic[8];
+      uint32_t version;
+      uint32_t reserved;
+      uint64_t num_vertices;
+      uint64_t num_edges;
+    };
+
+    template <typename T> bool WriteArray(FILE *fp, const vector<T> &v){
+      return fwrite(v.data(), sizeof(T), v.size(), fp) == v.size();
+    }
+
+    inline bool IsBlank(char c){ return c == ' ' || c == '\t' || c == '\r'; }
+
+    // Reads an integer at p, which must be followed by a blank, a line break or the end.
+    // Fails on values out of the range of int.
+    inline bool ParseInt(const char *&p, const char *end, int &x){
+      bool negative = p < end && *p == '-';
+      if (negative) p++;
+      if (p == end || *p < '0' || '9' < *p) return false;
+      const long long limit = negative ? -(long long)INT_MIN : INT_MAX;
+      long long y = 0;
+      for (; p < end && '0' <= *p && *p <= '9'; p++){
+        y = y * 10 + (*p - '0');
+        if (y > limit) return false;
+      }
+      x = negative ? -y : y;
+      return p == end || IsBlank(*p) || *p == '\n';
+    }
+
+    // Parses the lines in [p, end) and appends their edges to es.
+    bool ParseEdges(const char *p, const char *end, vector<pair<int, int> > &es){
+      while (p < end){
+        while (p < end && IsBlank(*p)) p++;
+        if (p < end && *p != '\n' && *p != '#'){
+          int u, v;
+          if (!ParseInt(p, end, u)) return false;
+          while (p < end && IsBlank(*p)) p++;
+          if (!ParseInt(p, end, v)) return false;
+          es.emplace_back(u, v);
+        }
+        const void *nl = memchr(p, '\n', end - p);
+        p = nl != nullptr ? static_cast<const char*>(nl) + 1 : end;
+      }
+      return true;
+    }
+  }
+
+  bool ReadTextGraph(const string &path, vector<pair<int, int> > &es, int num_threads){
+    es.clear();
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0){
+      close(fd);
+      return false;
+    }
+    size_t length = st.st_size;
+    if (length == 0){
+      close(fd);
+      return true;
+    }
+    void *addr = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) return false;
+    madvise(addr, length, MADV_SEQUENTIAL);
+    const char *data = static_cast<const char*>(addr);
+
+    // small files are not worth the threads
+    const size_t min_chunk_size = size_t(1) << 20;
+    if (num_threads <= 0) num_threads = max(1u, thread::hardware_concurrency());
+    size_t num_chunks = min<size_t>(num_threads, (length + min_chunk_size - 1) / min_chunk_size);
+
+    // each chunk but the first starts just after a line break
+    vector<size_t> begin(num_chunks + 1, length);
+    begin[0] = 0;
+    for (size_t i = 1; i < num_chunks; i++){
+      size_t pos = max(begin[i - 1], length / num_chunks * i);
+      const void *nl = pos > 0 ? memchr(data + pos - 1, '\n', length - pos + 1) : data;
+      begin[i] = nl != nullptr ? static_cast<const char*>(nl) - data + 1 : length;
+    }
+
+    vector<vector<pair<int, int> > > chunk_es(num_chunks);
+    vector<char> ok(num_chunks, false);
+    auto parse = [&](size_t i){ ok[i] = ParseEdges(data + begin[i], data + begin[i + 1], chunk_es[i]); };
+    vector<thread> threads;
+    for (size_t i = 1; i < num_chunks; i++) threads.emplace_back(parse, i);
+    parse(0);
+    for (auto &t : threads) t.join();
+    munmap(addr, length);
+    if (find(ok.begin(), ok.end(), false) != ok.end()) return false;
+
+    // concatenate in parallel as well, each chunk into its own range of es
+    vector<size_t> offsets(num_chunks + 1, 0);
+    for (size_t i = 0; i < num_chunks; i++) offsets[i + 1] = offsets[i] + chunk_es[i].size();
+    es.resize(offsets[num_chunks]);
+    auto concat = [&](size_t i){
+      copy(chunk_es[i].begin(), chunk_es[i].end(), es.begin() + offsets[i]);
+      vector<pair<int, int> >().swap(chunk_es[i]);
+    };
+    threads.clear();
+    for (size_t i = 1; i < num_chunks; i++) threads.emplace_back(concat, i);
+    concat(0);
+    for (auto &t : threads) t.join();
+    return true;
+  }
+
+  bool WriteBinaryGraph(const string &path, const vector<pair<int, int> > &es){
+    unordered_map<int, int> vertex2id;
+    vector<int32_t> ids;
+    for (const auto &e : es){
+      for (int v : {e.fst, e.snd}){
+        if (vertex2id.emplace(v, ids.size()).snd) ids.push_back(v);
+      }
+    }
+
+    size_t V = ids.size();
+    vector<uint64_t> offsets(V + 1, 0);
+    for (const auto &e : es){
+      if (e.fst != e.snd) offsets[vertex2id[e.fst] + 1]++;
+    }
+    for (size_t v = 0; v < V; v++) offsets[v + 1] += offsets[v];
+
+    vector<int32_t>  targets(offsets[V]);
+    vector<uint64_t> pos(offsets.begin(), offsets.end() - 1);
+    for (const auto &e : es){
+      if (e.fst != e.snd) targets[pos[vertex2id[e.fst]]++] = vertex2id[e.snd];
+    }
+    for (size_t v = 0; v < V; v++){
+      sort(targets.begin() + offsets[v], targets.begin() + offsets[v + 1]);
+    }
+
+    FILE *fp = fopen(path.c_str(), "wb");
+    if (fp == nullptr) return false;
+    Header header = Header();
+    memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version      = kVersion;
+    header.num_vertices = V;
+    header.num_edges    = es.size();
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+      WriteArray(fp, offsets) && WriteArray(fp, targets) && WriteArray(fp, ids);
+    ok &= fclose(fp) == 0;
+    return ok;
+  }
+
+  void MappedGraph::Close(){
+    if (addr != nullptr) munmap(addr, length);
+    addr = nullptr;
+    length = num_vertices = num_edges = 0;
+    offsets = nullptr;
+    targets = ids = nullptr;
+  }
+
+  bool MappedGraph::Open(const string &path){
+    Close();
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(Header)){
+      close(fd);
+      return false;
+    }
+    length = st.st_size;
+    addr   = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED){
+      addr = nullptr;
+      return false;
+    }
+
+    const char *p = static_cast<const char*>(addr);
+    Header header;
+    memcpy(&header, p, sizeof(header));
+    uint64_t V = header.num_vertices;
+    // sizes are compared step by step so that a broken header cannot overflow them
+    uint64_t rest = length - sizeof(Header);
+    bool ok = memcmp(header.magic, kMagic, sizeof(kMagic)) == 0 && header.version == kVersion &&
+      V < uint64_t(INT32_MAX) && (V + 1) * sizeof(uint64_t) + V * sizeof(int32_t) <= rest;
+    if (ok){
+      offsets = reinterpret_cast<const uint64_t*>(p + sizeof(Header));
+      rest   -= (V + 1) * sizeof(uint64_t) + V * sizeof(int32_t);
+      ok = offsets[0] == 0 && offsets[V] == rest / sizeof(int32_t) && rest % sizeof(int32_t) == 0;
+      for (uint64_t v = 0; v < V && ok; v++) ok = offsets[v] <= offsets[v + 1];
+    }
+    if (!ok){
+      Close();
+      return false;
+    }
+    num_vertices = V;
+    num_edges    = header.num_edges;
+    targets      = reinterpret_cast<const int32_t*>(offsets + V + 1);
+    ids          = targets + offsets[V];
+    // the pages are read once from the front to the back
+    madvise(addr, length, MADV_SEQUENTIAL);
+    return true;
+  }
+
+  vector<pair<int, int> > MappedGraph::ToEdgeList() const {
+    vector<pair<int, int> > es;
+    if (offsets == nullptr) return es;
+    es.reserve(offsets[num_vertices]);
+    // a vertex without edges appeared only in self loops, which it gets back as one
+    vector<bool> has_edge(num_vertices, false);
+    for (uint64_t i = 0; i < offsets[num_vertices]; i++){
+      CHECK(0 <= targets[i] && (size_t)targets[i] < num_vertices);
+      has_edge[targets[i]] = true;
+    }
+    for (size_t v = 0; v < num_vertices; v++){
+      if (!has_edge[v] && offsets[v] == offsets[v + 1]) es.emplace_back(ids[v], ids[v]);
+      for (uint64_t i = offsets[v]; i < offsets[v + 1]; i++){
+        es.emplace_back(ids[v], ids[targets[i]]);
+      }
+    }
+    return es;
+  }
+}
@@ -0,0 +1,65 @@
+#ifndef GRAPH_IO_H
+#define GRAPH_IO_H
+
+#include <vector>
+#include <string>
+#include <utility>
+#include <cstddef>
+#include <stdint.h>
+using std::vector;
+
+namespace betweenness_centrality {
+
+  // Reads a text edge list into es. Each line holds an edge as two integers
+  // separated by spaces or tabs, and anything after them is ignored. Blank
+  // lines and lines starting with '#' (comments, as in SNAP datasets) are
+  // skipped. The file is split at line boundaries and parsed by num_threads
+  // threads (all cores if 0), and the edges are stored in the order of the file.
+  // Returns false if the file cannot be read or has a line that is not an edge.
+  bool ReadTextGraph(const std::string &path, vector<std::pair<int, int> > &es, int num_threads = 0);
+
+  // Binary graph file in CSR form, laid out so that it can be used in place once mapped:
+  //   header   magic, format version, number of vertices V and of edges in the original edge list
+  //   offsets  uint64[V + 1]; the out-neighbors of vertex i are targets[offsets[i], offsets[i + 1])
+  //   targets  int32[offsets[V]], sorted for each vertex; self loops are dropped
+  //   ids      int32[V], the vertex of the original edge list for each vertex
+  // Vertices are numbered in the order in which they first appear in the
+  // edge list, as CentralityBase::BuildGraph does, so a graph built from the
+  // file is the same as one built from the edge list.
+  bool WriteBinaryGraph(const std::string &path, const vector<std::pair<int, int> > &es);
+
+  // Read-only mapping of a binary graph file.
+  class MappedGraph {
+  private:
+    void           *addr;
+    size_t          length;
+    uint64_t        num_vertices;
+    uint64_t        num_edges;
+    const uint64_t *offsets;
+    const int32_t  *targets;
+    const int32_t  *ids;
+
+    void Close();
+
+  public:
+    MappedGraph() : addr(nullptr), length(0), num_vertices(0), num_edges(0), offsets(nullptr), targets(nullptr), ids(nullptr) {}
+    ~MappedGraph(){ Close(); }
+    MappedGraph(const MappedGraph &) = delete;
+    MappedGraph &operator=(const MappedGraph &) = delete;
+
+    // Maps the file. Returns false if it cannot be mapped or is not a valid binary graph.
+    bool Open(const std::string &path);
+
+    inline size_t NumVertices() const { return num_vertices; }
+    inline size_t NumEdges() const { return num_edges; }
+    inline const uint64_t *Offsets() const { return offsets; }
+    inline const int32_t  *Targets() const { return targets; }
+    inline const int32_t  *OriginalIds() const { return ids; }
+
+    // The edge list with the original vertices, without self loops except
+    // one for each vertex that has no other edge, so that no vertex is lost.
+    vector<std::pair<int, int> > ToEdgeList() const;
+  };
+}
+
+#endif /* GRAPH_IO_H */
@@ -1,18 +1,205 @@
 #include "hyper_edge.hpp"
 #include "dynamic_centrality_hay.hpp"
 #include "common.hpp"
-#include <set>
-#include <queue>
+#include <algorithm>
 using namespace std;
 
 namespace betweenness_centrality {
 
+  void Workspace::Resize(size_t V){
+    for (int i = 0; i < 2; i++){
+      tmp_dist[i].resize(V, -1);
+      tmp_count[i].resize(V, 0);
+    }
+    tmp_passable.resize(V, false);
+    visited.Resize(V);
+  }
+
+  void Workspace::Clear(){
+    for (int i = 0; i < 2; i++){
+      tmp_dist[i].clear();
+      tmp_count[i].clear();
+    }
+    tmp_passable.clear();
+    visited = EpochVisited();
+    score_deltas.clear();
+    index_log.clear();
+    disconnected_log.clear();
+  }
+
+  void NodeDistanceMap::ToTable(){
+    assert(table == nullptr);
+    table = new(MemoryPool::Allocate(sizeof(Table))) Table();
+    table->set_empty_key(-1);
+    table->set_deleted_key(-2);
+    for (int i = 0; i < num_flat; i++){
+      (*table)[nodes[i]] = dists[i];
+    }
+    num_flat = 0;
+  }
+
+  void NodeDistanceMap::ToFlat(){
+    assert(table != nullptr && table->size() <= size_t(kFlatCapacity));
+    num_flat = 0;
+    for (const auto &p : *table){
+      nodes[num_flat] = p.first;
+      dists[num_flat] = p.second;
+      num_flat++;
+    }
+    table->~Table();
+    MemoryPool::Deallocate(table, sizeof(Table));
+    table = nullptr;
+  }
+
+  void NodeDistanceMap::Assign(const vector<pair<int, int> > &nodes){
+    Clear();
+    if (nodes.size() <= size_t(kFlatCapacity)){
+      for (auto p : nodes){
+        this->nodes[num_flat] = p.first;
+        this->dists[num_flat] = p.second;
+        num_flat++;
+      }
+    } else {
+      ToTable();
+      table->insert(nodes.begin(), nodes.end());
+    }
+  }
+
+  void NodeDistanceMap::EraseDistance(int d){
+    if (table != nullptr){
+      for (auto iter = table->begin(); iter != table->end();){
+        if (iter->second == d){
+          table->erase(iter++);
+        } else {
+          iter++;
+        }
+      }
+    } else {
+      for (int i = 0; i < num_flat;){
+        if (dists[i] == d){
+          num_flat--;
+          nodes[i] = nodes[num_flat];
+          dists[i] = dists[num_flat];
+        } else {
+          i++;
+        }
+      }
+    }
+  }
+
+  void NodeDistanceMap::Clear(){
+    if (table != nullptr){
+      table->~Table();
+      MemoryPool::Deallocate(table, sizeof(Table));
+      table = nullptr;
+    }
+    num_flat = 0;
+  }
+
+  void NodeDistanceMap::Compact(){
+    if (table == nullptr) return;
+    // 行ったり来たりしないよう, 半分まで減ってから戻す
+    if (table->size() <= size_t(kFlatCapacity / 2)){
+      ToFlat();
+    } else {
+      table->resize(0);
+    }
+  }
+
+  void ShortestPathDAG::Assign(const vector<int> &candidates, int distance,
+                               const vector<int> &dist_s, const vector<int> &dist_t,
+                               const vector<double> &count_s, const vector<double> &count_t){
+    // 層ごとの計数ソート. 片側から届かない候補は最短路に乗っていない
+    auto on_path = [&](int v){
+      return dist_s[v] != -1 && dist_t[v] != -1 && dist_s[v] + dist_t[v] == distance;
+    };
+    layer_begin.assign(distance + 2, 0);
+    for (int v : candidates){
+      if (on_path(v)) layer_begin[dist_s[v] + 1]++;
+    }
+    for (int d = 0; d <= distance; d++){
+      layer_begin[d + 1] += layer_begin[d];
+    }
+    
+    size_t n = layer_begin.back();
+    nodes.resize(n);
+    this->count_s.resize(n);
+    this->count_t.resize(n);
+    pool_vector<int> pos(layer_begin.begin(), layer_begin.end() - 1);
+    for (int v : candidates){
+      if (!on_path(v)) continue;
+      int i = pos[dist_s[v]]++;
+      nodes[i] = v;
+      this->count_s[i] = count_s[v];
+      this->count_t[i] = count_t[v];
+    }
+    BuildSlots();
+  }
+
+  void ShortestPathDAG::Clear(){
+    nodes.clear();
+    count_s.clear();
+    count_t.clear();
+    layer_begin.clear();
+    slots.clear();
+  }
+
+  void ShortestPathDAG::EraseUnreachable(){
+    size_t n = 0;
+    int    d = 0;
+    for (size_t i = 0; i < nodes.size(); i++){
+      while (layer_begin[d + 1] <= int(i)){
+        layer_begin[++d] = n;
+      }
+      if (count_s[i] != 0 && count_t[i] != 0){
+        nodes[n]   = nodes[i];
+        count_s[n] = count_s[i];
+        count_t[n] = count_t[i];
+        n++;
+      }
+    }
+    layer_begin.back() = n;
+    nodes.resize(n);
+    count_s.resize(n);
+    count_t.resize(n);
+    BuildSlots();
+  }
+
+  void ShortestPathDAG::Save(SnapshotWriter &out) const {
+    out.PutVector(nodes);
+    out.PutVector(count_s);
+    out.PutVector(count_t);
+    out.PutVector(layer_begin);
+  }
+
+  void ShortestPathDAG::Load(SnapshotReader &in){
+    in.GetVector(nodes);
+    in.GetVector(count_s);
+    in.GetVector(count_t);
+    in.GetVector(layer_begin);
+    BuildSlots();
+  }
+
+  void ShortestPathDAG::BuildSlots(){
+    if (nodes.size() <= size_t(kMaxScan)){
+      pool_vector<int>().swap(slots);
+      return;
+    }
+    size_t capacity = 1;
+    while (capacity < 2 * nodes.size()) capacity *= 2;
+    slots.assign(capacity, -1);
+    for (size_t i = 0; i < nodes.size(); i++){
+      size_t k = Slot(nodes[i]);
+      while (slots[k] != -1) k = (k + 1) & (capacity - 1);
+      slots[k] = i;
+    }
+  }
+
   void Ball::Build(const vector<pair<int, int> > &nodes, vector<vector<int> > *fadj, vector<vector<int> > *badj){
     radius = 0;
-    distance.clear();
     this->fadj = fadj;
     this->badj = badj;
-    distance.insert(nodes.begin(), nodes.end());
+    distance.Assign(nodes);
     
     for (auto p : nodes){
       if (p.second == 0){
@@ -22,21 +209,41 @@ namespace betweenness_centrality {
     }
   }
 
-  void Ball::Trace(const vector<int> &start_nodes, vector<int> &dag_nodes){
+  void Ball::Save(SnapshotWriter &out) const {
+    vector<pair<int, int> > nodes;
+    nodes.reserve(distance.Size());
+    distance.ForEach([&](int v, int d){ nodes.emplace_back(v, d); });
+    out.Put(source);
+    out.Put(radius);
+    out.PutVector(nodes);
+  }
+
+  void Ball::Load(SnapshotReader &in, vector<vector<int> > *fadj, vector<vector<int> > *badj){
+    vector<pair<int, int> > nodes;
+    this->fadj = fadj;
+    this->badj = badj;
+    source = in.Get<int>();
+    radius = in.Get<int>();
+    in.GetVector(nodes);
+    distance.Assign(nodes);
+  }
+
+  void Ball::Trace(const vector<int> &start_nodes, vector<int> &dag_nodes, Workspace &ws){
     // start_nodesがボールの中心から等しい距離にあることを仮定
-    queue<int> que;
-    set<int>   visit;
+    FlatQueue<int> &que   = ws.que[0];
+    EpochVisited   &visit = ws.visited;
+    que.Clear();
+    visit.Clear();
     for (int v : start_nodes){
-      que.push(v);
+      que.Push(v);
     }
-    while (!que.empty()){
-      int v = que.front(); que.pop();
+    while (!que.Empty()){
+      int v = que.Pop();
       int d = GetDistance(v);
       for (int w : badj->at(v)){
-        if (HasNode(w) && GetDistance(w) == d - 1 && visit.count(w) == 0){
-          visit.insert(w);
+        if (HasNode(w) && GetDistance(w) == d - 1 && visit.Visit(w)){
           dag_nodes.push_back(w);
-          que.push(w);
+          que.Push(w);
         }
       }
     }
@@ -44,35 +251,31 @@ namespace betweenness_centrality {
   
   void Ball::DecreaseRadius(){
     if (radius > 0){
-      for (auto iter = distance.begin(); iter != distance.end();){
-        if (iter->second == radius){
-          distance.erase(iter++);
-        } else {
-          iter++;
-        }
-      }
-      distance.resize(0);
+      distance.EraseDistance(radius);
+      distance.Compact();
       radius--;
     }
   }
   
-  void Ball::InsertEdge(int u, int v){
+  void Ball::InsertEdge(int u, int v, vector<int> &added_nodes, Workspace &ws){
     if (HasNode(u) && GetDistance(u) < radius){
-      queue<pair<int, int> > que;
+      FlatQueue<pair<int, int> > &que = ws.pair_que;
+      que.Clear();
       if (!HasNode(v) || GetDistance(v) > GetDistance(u) + 1){
-        
-        distance[v] = GetDistance(u) + 1;
-        que.push(make_pair(v, distance[v]));
+        if (!HasNode(v)) added_nodes.push_back(v);
+        distance.Set(v, GetDistance(u) + 1);
+        que.Push(make_pair(v, GetDistance(v)));
       }
 
-      while (!que.empty()){
-        int v = que.front().first;
-        int d = que.front().second; que.pop();
+      while (!que.Empty()){
+        int v = que.Front().first;
+        int d = que.Front().second; que.Pop();
         if (d == radius) continue;
         for (int w : fadj->at(v)){
           if (!HasNode(w) || GetDistance(w) > d + 1){
-            distance[w] = d + 1;
-            que.push(make_pair(w, d + 1));
+            if (!HasNode(w)) added_nodes.push_back(w);
+            distance.Set(w, d + 1);
+            que.Push(make_pair(w, d + 1));
           }
         }
       }
@@ -93,21 +296,22 @@ namespace betweenness_centrality {
     return -1;
   }
   
-  void Ball::CollectChanges(const vector<int> &start_nodes, vector<int> &updated_nodes){
-    queue<int>  que;
+  void Ball::CollectChanges(const vector<int> &start_nodes, vector<int> &updated_nodes, Workspace &ws){
+    FlatQueue<int> &que = ws.que[0];
     const int INF = fadj->size() + 1;
+    que.Clear();
         
     for (int v : start_nodes){
       assert(HasNode(v));
       if (FindParent(v) == -1){
-        que.push(v);
+        que.Push(v);
         tmp_dist->at(v) = INF;
         updated_nodes.push_back(v);
       }
     }
         
-    while (!que.empty()){
-      int v  = que.front(); que.pop();
+    while (!que.Empty()){
+      int v  = que.Pop();
       int dv = GetDistance(v);
       if (dv >= radius) continue;
       
@@ -117,7 +321,7 @@ namespace betweenness_centrality {
         
         if (FindParent(w) == -1){
           tmp_dist->at(w) = INF;
-          que.push(w);
+          que.Push(w);
         } else {
           tmp_dist->at(w) = GetDistance(w);
         }
@@ -127,10 +331,11 @@ namespace betweenness_centrality {
     }
   }
 
-  void Ball::FixChanges(const vector<int> &nodes){
+  void Ball::FixChanges(const vector<int> &nodes, Workspace &ws){
     // 辺・頂点削除後のnodesの中心からの距離を確定する
     typedef pair<int, int> PI;
-    priority_queue<PI, vector<PI>, greater<PI> > que;
+    FlatHeap<PI> &que = ws.heap;
+    que.Clear();
         
     for (int v : nodes){
       assert(tmp_dist->at(v) != -1);
@@ -144,12 +349,12 @@ namespace betweenness_centrality {
           tmp_dist->at(v) = min(dw + 1, tmp_dist->at(v));
         }
       }
-      que.push(PI(tmp_dist->at(v), v));
+      que.Push(PI(tmp_dist->at(v), v));
     }
     
-    while (!que.empty()){
-      int d = que.top().first;
-      int v = que.top().second; que.pop();
+    while (!que.Empty()){
+      int d = que.Top().first;
+      int v = que.Top().second; que.Pop();
       if (d > tmp_dist->at(v) || d >= radius) continue;
       
       for (int w : fadj->at(v)){
@@ -158,27 +363,29 @@ namespace betweenness_centrality {
         
         if (is_red && tmp_dist->at(v) + 1 < tmp_dist->at(w)){
           tmp_dist->at(w) = tmp_dist->at(v) + 1;
-          que.push(PI(tmp_dist->at(w), w));
+          que.Push(PI(tmp_dist->at(w), w));
         }
       }
     }
     for (int v : nodes){
       if (tmp_dist->at(v) <= radius){
-        distance[v] = tmp_dist->at(v);
+        distance.Set(v, tmp_dist->at(v));
       } else {
-        distance.erase(v);
+        distance.Erase(v);
       }
       tmp_dist->at(v) = -1;
     }
-    distance.resize(0);
+    distance.Compact();
   }
   
-  void Ball::DeleteEdge(int u, int v){
+  void Ball::DeleteEdge(int u, int v, Workspace &ws){
     if (HasNode(u) && HasNode(v) && GetDistance(u) + 1 == GetDistance(v)){
-      vector<int> start_nodes = {v};
-      vector<int> upd_nodes;
-      CollectChanges(start_nodes, upd_nodes);
-      FixChanges(upd_nodes);
+      vector<int> &start_nodes = ws.frontier[0];
+      vector<int> &upd_nodes   = ws.frontier[1];
+      start_nodes.assign(1, v);
+      upd_nodes.clear();
+      CollectChanges(start_nodes, upd_nodes, ws);
+      FixChanges(upd_nodes, ws);
     }
   }
   
@@ -187,73 +394,162 @@ namespace betweenness_centrality {
     assert(tmp_dist == nullptr || v < (int)tmp_dist->size());
   }
 
-  void Ball::DeleteNode(int u, const vector<int> &u_out, const vector<int> &){
+  void Ball::DeleteNode(int u, const vector<int> &u_out, const vector<int> &, Workspace &ws){
     // 辺の情報の更新はボールの更新より後
     if (HasNode(u)){
-      distance.erase(u);
-      vector<int> start_nodes;
-      vector<int> upd_nodes;
+      distance.Erase(u);
+      vector<int> &start_nodes = ws.frontier[0];
+      vector<int> &upd_nodes   = ws.frontier[1];
+      start_nodes.clear();
+      upd_nodes.clear();
 
       for (int v : u_out){
         if (this->HasNode(v)) start_nodes.push_back(v);
       }
-      CollectChanges(start_nodes, upd_nodes);
-      FixChanges(upd_nodes);
+      CollectChanges(start_nodes, upd_nodes, ws);
+      FixChanges(upd_nodes, ws);
+    }
+  }
+
+  void Ball::Repair(const vector<pair<int, int> > &deleted, const vector<pair<int, int> > &inserted,
+                    bool backward, vector<int> &added_nodes, Workspace &ws){
+    // 削除された最短路の辺より下流の頂点の距離をいったん捨て,
+    // 残った頂点と挿入された辺からバッチ後のグラフで測り直す
+    typedef pair<int, int> PI;
+    const int INF = fadj->size() + 1;
+    FlatQueue<int> &que     = ws.que[0];
+    FlatHeap<PI>   &heap    = ws.heap;
+    vector<int>    &touched = ws.frontier[0];
+    que.Clear();
+    heap.Clear();
+    touched.clear();
+    auto current = [&](int v){
+      return tmp_dist->at(v) != -1 ? tmp_dist->at(v) : HasNode(v) ? GetDistance(v) : INF;
+    };
+    auto lower = [&](int v, int d){
+      if (tmp_dist->at(v) == -1) touched.push_back(v);
+      tmp_dist->at(v) = d;
+      heap.Push(PI(d, v));
+    };
+    
+    for (auto e : deleted){
+      int u = backward ? e.second : e.first;
+      int v = backward ? e.first  : e.second;
+      if (HasNode(u) && HasNode(v) && GetDistance(u) + 1 == GetDistance(v) && tmp_dist->at(v) == -1){
+        tmp_dist->at(v) = INF;
+        touched.push_back(v);
+        que.Push(v);
+      }
+    }
+    while (!que.Empty()){
+      int v  = que.Pop();
+      int dv = GetDistance(v);
+      if (dv >= radius) continue;
+      for (int w : fadj->at(v)){
+        if (HasNode(w) && GetDistance(w) == dv + 1 && tmp_dist->at(w) == -1){
+          tmp_dist->at(w) = INF;
+          touched.push_back(w);
+          que.Push(w);
+        }
+      }
+    }
+    
+    // 距離を捨てた頂点は捨てていない頂点から, 挿入された辺の先は元からボールにある頂点から
+    size_t num_invalid = touched.size();
+    for (size_t i = 0; i < num_invalid; i++){
+      int v = touched[i];
+      for (int w : badj->at(v)){
+        if (HasNode(w) && tmp_dist->at(w) == -1) tmp_dist->at(v) = min(tmp_dist->at(v), GetDistance(w) + 1);
+      }
+      if (tmp_dist->at(v) <= radius) heap.Push(PI(tmp_dist->at(v), v));
+    }
+    for (auto e : inserted){
+      int u = backward ? e.second : e.first;
+      int v = backward ? e.first  : e.second;
+      if (!HasNode(u) || tmp_dist->at(u) != -1) continue;
+      int d = GetDistance(u) + 1;
+      if (d <= radius && d < current(v)) lower(v, d);
+    }
+    
+    while (!heap.Empty()){
+      int d = heap.Top().first;
+      int v = heap.Top().second; heap.Pop();
+      if (d > tmp_dist->at(v) || d >= radius) continue;
+      for (int w : fadj->at(v)){
+        if (d + 1 < current(w)) lower(w, d + 1);
+      }
+    }
+    
+    for (int v : touched){
+      if (tmp_dist->at(v) <= radius){
+        if (!HasNode(v)) added_nodes.push_back(v);
+        distance.Set(v, tmp_dist->at(v));
+      } else {
+        distance.Erase(v);
+      }
+      tmp_dist->at(v) = -1;
     }
+    distance.Compact();
   }
 
   
   void Intersection(const Ball &bp, const Ball &bq, vector<int> &vec){
     vec.clear();
-    const auto &bp_dist = bp.distance;
-    const auto &bq_dist = bq.distance;
-    for (const auto &p : bp_dist){
-      if (bq_dist.find(p.first) != bq_dist.end()) vec.push_back(p.first);
-    }
+    // 小さい方のボールを走査する
+    const Ball &small = bp.GetBallSize() <= bq.GetBallSize() ? bp : bq;
+    const Ball &large = bp.GetBallSize() <= bq.GetBallSize() ? bq : bp;
+    small.distance.ForEach([&](int v, int){
+        if (large.HasNode(v)) vec.push_back(v);
+      });
   }
 
   
   bool HyperEdge::
-  BidirectionalSearch(int s, int t){
+  BidirectionalSearch(int s, int t, Workspace &ws){
     assert(s != t);
     int         s_curr = 0, s_next = 2;
     int         t_curr = 1, t_next = 3;
-    queue<int>  que[4];
-    vector<int> update[2];
-    que[s_curr].push(s); dch->tmp_dist[s_curr][s] = 0; update[s_curr].push_back(s);
-    que[t_curr].push(t); dch->tmp_dist[t_curr][t] = 0; update[t_curr].push_back(t);
+    FlatQueue<int> *que    = ws.que;
+    vector<int>    *update = ws.frontier;
+    for (int i = 0; i < 4; i++) que[i].Clear();
+    update[0].clear();
+    update[1].clear();
+    que[s_curr].Push(s); ws.tmp_dist[s_curr][s] = 0; update[s_curr].push_back(s);
+    que[t_curr].Push(t); ws.tmp_dist[t_curr][t] = 0; update[t_curr].push_back(t);
     
     bool found = false;
-    while (!que[s_curr].empty() && !que[t_curr].empty()){
+    while (!que[s_curr].Empty() && !que[t_curr].Empty()){
       int &curr = (update[0].size() <= update[1].size()) ? s_curr : t_curr;
       int &next = (update[0].size() <= update[1].size()) ? s_next : t_next;
       bool from_s = curr % 2 == 0;
       
-      while (!que[curr].empty()){
-        int v = que[curr].front(); que[curr].pop();
+      while (!que[curr].Empty()){
+        int v = que[curr].Pop();
         int p = curr % 2;
         const auto &adj = from_s ? dch->G[0][v] : dch->G[1][v];
         
         for (int w : adj){
-          int &src_d = dch->tmp_dist[    p][w];
-          int &dst_d = dch->tmp_dist[1 - p][w];
+          int &src_d = ws.tmp_dist[    p][w];
+          int &dst_d = ws.tmp_dist[1 - p][w];
           if (src_d != -1) continue;
           if (dst_d != -1) found = true;
-          que[next].push(w);
+          que[next].Push(w);
           update[p].push_back(w);
-          dch->tmp_dist[p][w] = dch->tmp_dist[p][v] + 1;
+          ws.tmp_dist[p][w] = ws.tmp_dist[p][v] + 1;
         }
       }
       if (found) goto LOOP_END;
+      que[curr].Clear();
       swap(curr, next);
     }
   LOOP_END:
     
     if (found){
+      vector<pair<int, int> > &nodes = ws.ball_nodes;
       for (int i = 0; i < 2; i++){
-        vector<pair<int, int> > nodes;
+        nodes.clear();
         for (auto v : update[i]){
-          nodes.push_back(make_pair(v, dch->tmp_dist[i][v]));
+          nodes.push_back(make_pair(v, ws.tmp_dist[i][v]));
         }
         if (i == 0){
           ball_s.Build(nodes, &dch->G[0], &dch->G[1]);
@@ -264,26 +560,26 @@ namespace betweenness_centrality {
     } 
 
     for (int i = 0; i < 2; i++){
-      for (int v : update[i]) dch->tmp_dist[i][v] =  -1;
+      for (int v : update[i]) ws.tmp_dist[i][v] =  -1;
     }
     return found;
   }
 
   void HyperEdge::
-  ComputeNumPaths(int s, const vector<vector<int> >  &adj, vector<int> &dist, vector<double> &count){
-    queue<int> que;
-    que.push(s);
+  ComputeNumPaths(int s, const vector<vector<int> >  &adj, vector<int> &dist, vector<double> &count, const vector<int> &passable, FlatQueue<int> &que){
+    que.Clear();
+    que.Push(s);
     dist[s] = 0;
     count[s] = 1;
     
-    while (!que.empty()){
-      int v = que.front(); que.pop();
+    while (!que.Empty()){
+      int v = que.Pop();
       for (int w : adj[v]){
         int next_dist = dist[v] + 1;
-        if (!dch->tmp_passable[w]) continue;
+        if (!passable[w]) continue;
         if (dist[w] == -1){
           dist[w] = next_dist;
-          que.push(w);
+          que.Push(w);
         }
         if (dist[w] == next_dist){
           count[w] += count[v];
@@ -292,46 +588,49 @@ namespace betweenness_centrality {
     }
   }
 
-  void HyperEdge::CalcWeight(){
-    vector<int> common_nodes;
+  void HyperEdge::CalcWeight(Workspace &ws){
+    vector<int> &common_nodes = ws.common_nodes;
+    vector<int> &dag_nodes    = ws.dag_nodes;
     Intersection(ball_s, ball_t, common_nodes);
-    vector<int> dag_nodes = common_nodes;
-    ball_s.Trace(common_nodes, dag_nodes);
-    ball_t.Trace(common_nodes, dag_nodes);
-    CalcWeight(dag_nodes);
+    dag_nodes = common_nodes;
+    ball_s.Trace(common_nodes, dag_nodes, ws);
+    ball_t.Trace(common_nodes, dag_nodes, ws);
+    CalcWeight(dag_nodes, ws);
   }
   
-  void HyperEdge::CalcWeight(const vector<int> &dag_nodes){
+  bool HyperEdge::CalcWeight(const vector<int> &dag_nodes, Workspace &ws, int expected_distance){
     assert(is_connected);
-    scores.clear();
-    dists.clear();
-    vector<int>    &dist_s  = dch->tmp_dist[0];
-    vector<int>    &dist_t  = dch->tmp_dist[1];
-    vector<double> &count_s = dch->tmp_count[0];
-    vector<double> &count_t = dch->tmp_count[1];
+    vector<int>    &dist_s  = ws.tmp_dist[0];
+    vector<int>    &dist_t  = ws.tmp_dist[1];
+    vector<double> &count_s = ws.tmp_count[0];
+    vector<double> &count_t = ws.tmp_count[1];
     
     for (int v : dag_nodes){
-      dch->tmp_passable[v] = true;
+      ws.tmp_passable[v] = true;
     }
     
-    ComputeNumPaths(source, dch->G[0], dist_s, count_s);
-    ComputeNumPaths(target, dch->G[1], dist_t, count_t);
+    ComputeNumPaths(source, dch->G[0], dist_s, count_s, ws.tmp_passable, ws.que[0]);
+    ComputeNumPaths(target, dch->G[1], dist_t, count_t, ws.tmp_passable, ws.que[0]);
     
-    double num_paths = count_s[target];
-    assert(num_paths > 0);
+    bool kept = expected_distance == -1 || dist_s[target] == expected_distance;
+    if (kept){
+      double num_paths = count_s[target];
+      assert(num_paths > 0);
 
-    this->distance = dist_s[target];
+      this->distance = dist_s[target];
       
-    for (int v : dag_nodes){
-      double w  = count_s[v] * count_t[v] / num_paths;
-      if (dist_s[v] + dist_t[v] == distance){
-        this->scores[v] = w;
-        this->dists[v]  = dist_s[v];
+      dag.Assign(dag_nodes, distance, dist_s, dist_t, count_s, count_t);
+      for (size_t i = 0; i < dag.Size(); i++){
+        IndexNode(dag.GetNode(i), ws);
       }
+    }
+    
+    for (int v : dag_nodes){
       count_s[v] = count_t[v] = 0;
       dist_s[v] = dist_t[v] = -1;
-      dch->tmp_passable[v] = false;
+      ws.tmp_passable[v] = false;
     }
+    if (!kept) return false;
 
     while (ball_s.GetRadius() + ball_t.GetRadius() + dch->tradeoff_param >= distance){
       auto &ball = ball_s.GetBallSize() > ball_t.GetBallSize() ? ball_s : ball_t;
@@ -339,53 +638,184 @@ namespace betweenness_centrality {
       
       if (ball_s.GetRadius() + ball_t.GetRadius() == 0) break;
     }
+    return true;
+  }
+  
+  void HyperEdge::
+  RecountPaths(const vector<int> &start_nodes, bool forward, Workspace &ws){
+    // start_nodesはDAG上の同じ層にあることを仮定.
+    // そこから辿れるDAG上の頂点の経路数を層ごとに数え直す
+    const auto &next_adj = dch->G[forward ? 0 : 1];
+    const auto &prev_adj = dch->G[forward ? 1 : 0];
+    const int step = forward ? 1 : -1;
+    EpochVisited &visited = ws.visited;
+    vector<int>  &curr    = ws.frontier[0];
+    vector<int>  &next    = ws.frontier[1];
+    visited.Clear();
+    curr.clear();
+    next.clear();
+    
+    for (int v : start_nodes){
+      if (visited.Visit(v)) curr.push_back(v);
+    }
+    
+    while (!curr.empty()){
+      for (int v : curr){
+        int i = dag.Find(v);
+        int d = dag.GetLayer(i);
+        double c = 0;
+        for (int w : prev_adj[v]){
+          int j = dag.Find(w);
+          if (j != -1 && dag.InLayer(j, d - step)) c += forward ? dag.CountS(j) : dag.CountT(j);
+        }
+        (forward ? dag.CountS(i) : dag.CountT(i)) = c;
+        
+        for (int w : next_adj[v]){
+          int j = dag.Find(w);
+          if (j != -1 && dag.InLayer(j, d + step) && visited.Visit(w)){
+            next.push_back(w);
+          }
+        }
+      }
+      curr.swap(next);
+      next.clear();
+    }
+  }
+
+  void HyperEdge::
+  RecountDAG(const vector<int> &down_nodes, const vector<int> &up_nodes, Workspace &ws){
+    // sourceとtargetの距離が変わらない削除の後, DAGの一部だけで経路数を数え直す.
+    // down_nodesより下流はcount_sだけが, up_nodesより上流はcount_tだけが変わる
+    RecountPaths(down_nodes, true , ws);
+    RecountPaths(up_nodes  , false, ws);
+    // 経路数が0になった頂点はもうsourceからtargetへの最短路に乗っていない
+    dag.EraseUnreachable();
+    assert(dag.GetNumPaths() > 0);
+  }
+  
+  void HyperEdge::UpdateScore(int v, double delta, Workspace &ws){
+    if (ws.skip_scores) return;
+    if (ws.defer_scores){
+      ws.score_deltas.emplace_back(v, delta);
+    } else {
+      dch->AddScore(v, delta);
+    }
+  }
+  
+  void HyperEdge::IndexNode(int v, Workspace &ws){
+    if (indexed_nodes.insert(v).second){
+      ws.index_log.emplace_back(v, id);
+    }
+  }
+
+  void HyperEdge::IndexNodes(Workspace &ws){
+    if (!is_connected){
+      if (source != target) ws.disconnected_log.push_back(id);
+      return;
+    }
+    ball_s.ForEachNode([&](int v){ IndexNode(v, ws); });
+    ball_t.ForEachNode([&](int v){ IndexNode(v, ws); });
+    for (size_t i = 0; i < dag.Size(); i++) IndexNode(dag.GetNode(i), ws);
+  }
+
+  void HyperEdge::Reindex(int new_id, Workspace &ws){
+    id = new_id;
+    indexed_nodes.clear();
+    IndexNodes(ws);
   }
   
-  void HyperEdge::AddWeight(){
+  void HyperEdge::AddWeight(Workspace &ws){
     if (!is_connected) return;
-    for (const auto p : scores){
-      if (p.first != source && p.first != target){
-        dch->score[p.first] += p.second;
+    for (size_t i = 0; i < dag.Size(); i++){
+      int v = dag.GetNode(i);
+      if (v != source && v != target){
+        UpdateScore(v, dag.GetWeight(i), ws);
       }
     }
   }
   
-  void HyperEdge::SubWeight(){
+  void HyperEdge::SubWeight(Workspace &ws){
     if (!is_connected) return;
-    for (const auto p : scores){
-      if (p.first != source && p.first != target){
-        dch->score[p.first] -= p.second;
+    for (size_t i = 0; i < dag.Size(); i++){
+      int v = dag.GetNode(i);
+      if (v != source && v != target){
+        UpdateScore(v, -dag.GetWeight(i), ws);
       }
     }
   }
 
-  HyperEdge::HyperEdge(int s, int t, DynamicCentralityHAY *dch)
-    : is_connected(false), source(s), target(t), dch(dch)
+  HyperEdge::HyperEdge(int s, int t, int id, DynamicCentralityHAY *dch, Workspace &ws)
+    : is_connected(false), id(id), source(s), target(t), distance(0), dch(dch), prq(nullptr)
   {
-    scores.set_empty_key(-1); scores.set_deleted_key(-2);
-    dists.set_empty_key(-1); dists.set_deleted_key(-2);
+    indexed_nodes.set_empty_key(-1); indexed_nodes.set_deleted_key(-2);
     
     if (s != t){
-      prq = dch->spr_index->CreateQuerier(s, t);
-      is_connected = BidirectionalSearch(s, t);
+      is_connected = BidirectionalSearch(s, t, ws);
+      UpdateQuerier(ws);
       if (is_connected){
-        CalcWeight();
+        CalcWeight(ws);
         // cout << s << " " << t << " OK" << endl;
-        // for (const auto &p : scores){
-        //   cout << p << endl;
+        // for (size_t i = 0; i < dag.Size(); i++){
+        //   cout << dag.GetNode(i) << " " << dag.GetWeight(i) << endl;
         // }
-        AddWeight();
+        AddWeight(ws);
       }
+      IndexNodes(ws);
+    }
+  }
+
+  HyperEdge::HyperEdge(SnapshotReader &in, int id, DynamicCentralityHAY *dch)
+    : id(id), dch(dch), prq(nullptr)
+  {
+    indexed_nodes.set_empty_key(-1); indexed_nodes.set_deleted_key(-2);
+    source       = in.Get<int>();
+    target       = in.Get<int>();
+    is_connected = in.Get<char>();
+    distance     = in.Get<int>();
+    
+    int querier_id = in.Get<int>();
+    const auto &queriers = dch->spr_index->GetQueriers();
+    if (querier_id >= 0 && (size_t)querier_id < queriers.size()) prq = queriers[querier_id];
+    
+    ball_s.Load(in, &dch->G[0], &dch->G[1]);
+    ball_t.Load(in, &dch->G[1], &dch->G[0]);
+    dag.Load(in);
+  }
+
+  void HyperEdge::Save(SnapshotWriter &out, int querier_id) const {
+    out.Put(source);
+    out.Put(target);
+    out.Put<char>(is_connected);
+    out.Put(distance);
+    out.Put(querier_id);
+    ball_s.Save(out);
+    ball_t.Save(out);
+    dag.Save(out);
+  }
+
+  HyperEdge::~HyperEdge(){
+    // hyper-edges are only destroyed by the thread that owns dch->workspaces[0].
+    if (source != target && is_connected && !dch->discard_weights) SubWeight(dch->workspaces[0]);
+    if (prq != nullptr) dch->spr_index->RemoveQuerier(prq);
+  }
+
+  void HyperEdge::UpdateQuerier(Workspace &ws){
+    if (!is_connected && prq == nullptr && source != target){
+      prq = dch->spr_index->CreateQuerier(source, target, ws.que[0]);
+    } else if (is_connected && prq != nullptr){
+      dch->spr_index->RemoveQuerier(prq);
+      prq = nullptr;
     }
   }
 
-  bool HyperEdge::RecomputeIndex(){
-    scores.clear();
-    dists.clear();
-    is_connected = BidirectionalSearch(source, target);
+  bool HyperEdge::RecomputeIndex(Workspace &ws){
+    dag.Clear();
+    is_connected = BidirectionalSearch(source, target, ws);
+    UpdateQuerier(ws);
     if (is_connected){
-      CalcWeight();
+      CalcWeight(ws);
     }
+    IndexNodes(ws);
     return is_connected;
   }
   
@@ -396,7 +826,8 @@ namespace betweenness_centrality {
                const vector<vector<int> >  &badj, 
                vector<int> &tmp_dist,
                vector<int> &dag_nodes,
-               vector<int> &intersection)
+               vector<int> &intersection,
+               Workspace   &ws)
   {
     if (goal.HasNode(start_node)){
       intersection.push_back(start_node);
@@ -407,23 +838,21 @@ namespace betweenness_centrality {
       return;
     }
     
-    vector<int> updated_nodes;
-    queue<int>  que;
-
-    que.push(start_node);
-    updated_nodes.push_back(start_node);
+    // queに積んだ頂点がそのままtmp_distを戻すべき頂点になる
+    FlatQueue<int> &que = ws.que[0];
+    que.Clear();
+    que.Push(start_node);
     tmp_dist[start_node] = 0;
 
-    while (!que.empty()){
-      int v = que.front(); que.pop();
+    while (!que.Empty()){
+      int v = que.Pop();
       
       if (tmp_dist[v] == max_radius) break;
       
       for (int w : fadj[v]){
         if (tmp_dist[w] == -1){
           tmp_dist[w] = tmp_dist[v] + 1;
-          que.push(w);
-          updated_nodes.push_back(w);
+          que.Push(w);
           
           if (goal.HasNode(w)){
             max_radius = min(max_radius, tmp_dist[w]);
@@ -434,32 +863,33 @@ namespace betweenness_centrality {
     }
 
     if (!intersection.empty()){
-      queue<int> que;
+      FlatQueue<int> &back_que      = ws.que[1];
+      EpochVisited   &visited_nodes = ws.visited;
+      back_que.Clear();
+      visited_nodes.Clear();
       for (int v: intersection){
-        que.push(v);
+        back_que.Push(v);
       }
-      set<int> visited_nodes;
 
-      while (!que.empty()){
-        int v = que.front(); que.pop();
+      while (!back_que.Empty()){
+        int v = back_que.Pop();
         for (int w: badj[v]){
-          if (visited_nodes.count(w) == 0 && tmp_dist[w] + 1 == tmp_dist[v] && tmp_dist[w] >= 0){
-            que.push(w);
+          if (tmp_dist[w] + 1 == tmp_dist[v] && tmp_dist[w] >= 0 && visited_nodes.Visit(w)){
+            back_que.Push(w);
             dag_nodes.push_back(w);
-            visited_nodes.insert(w);
           }
         }
       }
     }
     
-    for (int v : updated_nodes){
+    for (int v : que.Pushed()){
       tmp_dist[v] = -1;
     }
   }
 
   
 
-  void HyperEdge::UpdateDAGbyInsertion1(int u, int v){
+  void HyperEdge::UpdateDAGbyInsertion1(int u, int v, Workspace &ws){
     assert(ball_s.HasNode(u));
 
     bool u_in_s = ball_s.HasNode(u);
@@ -474,39 +904,41 @@ namespace betweenness_centrality {
       int max_radius = v_in_s ?
         (distance - dv - ball_t.GetRadius()) :
         (distance - du - ball_t.GetRadius());
-      vector<int> &dist_s = dch->tmp_dist[0];
-      vector<int>  dag_nodes;
-      vector<int>  inter_nodes;
+      vector<int> &dist_s = ws.tmp_dist[0];
+      vector<int> &dag_nodes   = ws.dag_nodes;
+      vector<int> &inter_nodes = ws.inter_nodes[0];
+      dag_nodes.clear();
+      inter_nodes.clear();
           
       Explore(v, max_radius, ball_t, dch->G[0], dch->G[1],
-              dist_s, dag_nodes, inter_nodes);
+              dist_s, dag_nodes, inter_nodes, ws);
           
       // compute DAG!
       if (!inter_nodes.empty()){
-        ball_s.Trace({u}        , dag_nodes);
-        ball_t.Trace(inter_nodes, dag_nodes);
+        ws.frontier[0].assign(1, u);
+        ball_s.Trace(ws.frontier[0], dag_nodes, ws);
+        ball_t.Trace(inter_nodes   , dag_nodes, ws);
         
         for (int w : inter_nodes){
           dag_nodes.push_back(w);
         }
         dag_nodes.push_back(u);
         
-        for (auto p : scores){
-          dag_nodes.push_back(p.first);
+        for (size_t i = 0; i < dag.Size(); i++){
+          dag_nodes.push_back(dag.GetNode(i));
         }
         sort(dag_nodes.begin(), dag_nodes.end());
         dag_nodes.erase(unique(dag_nodes.begin(), dag_nodes.end()), dag_nodes.end());
         
-        SubWeight();
-        is_connected = RecomputeIndex();
-        CalcWeight(dag_nodes);
-        AddWeight();
+        SubWeight(ws);
+        CalcWeight(dag_nodes, ws);
+        AddWeight(ws);
       }
     }
   }
   
 
-  void HyperEdge::UpdateDAGbyInsertion2(int u, int v){
+  void HyperEdge::UpdateDAGbyInsertion2(int u, int v, Workspace &ws){
     // // UpdateDAGbyInsertion1との重複がひどい
     assert(ball_t.HasNode(v));
     
@@ -521,56 +953,62 @@ namespace betweenness_centrality {
       int max_radius = u_in_t ?
         (distance - du - ball_s.GetRadius()) :
         (distance - dv - ball_s.GetRadius());
-      vector<int> &dist_t = dch->tmp_dist[0];
-      vector<int>  dag_nodes;
-      vector<int>  inter_nodes;
+      vector<int> &dist_t = ws.tmp_dist[0];
+      vector<int> &dag_nodes   = ws.dag_nodes;
+      vector<int> &inter_nodes = ws.inter_nodes[0];
+      dag_nodes.clear();
+      inter_nodes.clear();
       
       Explore(u, max_radius, ball_s, dch->G[1], dch->G[0],
-              dist_t, dag_nodes, inter_nodes);
+              dist_t, dag_nodes, inter_nodes, ws);
           
       // compute DAG!
       if (!inter_nodes.empty()){
-        ball_t.Trace({v}        , dag_nodes);
-        ball_s.Trace(inter_nodes, dag_nodes);
+        ws.frontier[0].assign(1, v);
+        ball_t.Trace(ws.frontier[0], dag_nodes, ws);
+        ball_s.Trace(inter_nodes   , dag_nodes, ws);
         for (int w : inter_nodes){
           dag_nodes.push_back(w);
         }
         dag_nodes.push_back(v);
-        for (auto p : scores){
-          dag_nodes.push_back(p.first);
+        for (size_t i = 0; i < dag.Size(); i++){
+          dag_nodes.push_back(dag.GetNode(i));
         }
         sort(dag_nodes.begin(), dag_nodes.end());
         dag_nodes.erase(unique(dag_nodes.begin(), dag_nodes.end()), dag_nodes.end());
         
-        SubWeight();
-        CalcWeight(dag_nodes);
-        AddWeight();
+        SubWeight(ws);
+        CalcWeight(dag_nodes, ws);
+        AddWeight(ws);
       }
     }
   }
 
-  void HyperEdge::UpdateDAGbyInsertion3(int u, int v){
+  void HyperEdge::UpdateDAGbyInsertion3(int u, int v, Workspace &ws){
     // // UpdateDAGbyInsertion1との重複がひどい
     bool u_in_s = ball_s.HasNode(u), v_in_s = ball_s.HasNode(v);
     bool u_in_t = ball_t.HasNode(u), v_in_t = ball_t.HasNode(v);
     assert(!u_in_s && !u_in_t && !v_in_s && !v_in_t);
     
-    vector<int> dag_nodes;
-    vector<int> inter_nodes1;
-    vector<int> inter_nodes2;
+    vector<int> &dag_nodes    = ws.dag_nodes;
+    vector<int> &inter_nodes1 = ws.inter_nodes[0];
+    vector<int> &inter_nodes2 = ws.inter_nodes[1];
+    dag_nodes.clear();
+    inter_nodes1.clear();
+    inter_nodes2.clear();
     const auto &fadj = dch->G[0];
     const auto &badj = dch->G[1];
-    vector<int> &dist_s = dch->tmp_dist[0];
-    vector<int> &dist_t = dch->tmp_dist[1];
+    vector<int> &dist_s = ws.tmp_dist[0];
+    vector<int> &dist_t = ws.tmp_dist[1];
 
     int max_radius = dch->tradeoff_param;
-    Explore(u, max_radius, ball_s, badj, fadj, dist_t, dag_nodes, inter_nodes1);
-    Explore(v, max_radius, ball_t, fadj, badj, dist_s, dag_nodes, inter_nodes2);
+    Explore(u, max_radius, ball_s, badj, fadj, dist_t, dag_nodes, inter_nodes1, ws);
+    Explore(v, max_radius, ball_t, fadj, badj, dist_s, dag_nodes, inter_nodes2, ws);
     
     if (!inter_nodes1.empty() && !inter_nodes2.empty()){
       // compute DAG!
-      ball_s.Trace(inter_nodes1, dag_nodes);
-      ball_t.Trace(inter_nodes2, dag_nodes);
+      ball_s.Trace(inter_nodes1, dag_nodes, ws);
+      ball_t.Trace(inter_nodes2, dag_nodes, ws);
       
       for (int w : inter_nodes1){
         dag_nodes.push_back(w);
@@ -580,55 +1018,141 @@ namespace betweenness_centrality {
         dag_nodes.push_back(w);
       }
       
-      for (auto p : scores){
-        dag_nodes.push_back(p.first);
+      for (size_t i = 0; i < dag.Size(); i++){
+        dag_nodes.push_back(dag.GetNode(i));
       }
 
       sort(dag_nodes.begin(), dag_nodes.end());
       dag_nodes.erase(unique(dag_nodes.begin(), dag_nodes.end()), dag_nodes.end());
 
-      SubWeight();
-      CalcWeight(dag_nodes);
-      AddWeight();
+      SubWeight(ws);
+      CalcWeight(dag_nodes, ws);
+      AddWeight(ws);
     }
   }
   
-  void HyperEdge::InsertEdge(int u, int v){
+  void HyperEdge::InsertEdge(int u, int v, Workspace &ws){
     // // cout << "INSERT: " << u << " " << v << " " << source << " " << target << endl;
     if (source == target) return;
     
     if (is_connected){
       // 先にボールを更新する.
+      vector<int> &added_nodes = ws.added_nodes;
+      added_nodes.clear();
       if (ball_s.HasNode(u)){
-        ball_s.SetTempDist(&dch->tmp_dist[0]);
-        ball_s.InsertEdge(u, v);
+        ball_s.SetTempDist(&ws.tmp_dist[0]);
+        ball_s.InsertEdge(u, v, added_nodes, ws);
         ball_s.UnsetTempDist();
       }
       
       if (ball_t.HasNode(v)){
-        ball_t.SetTempDist(&dch->tmp_dist[0]);
-        ball_t.InsertEdge(v, u);
+        ball_t.SetTempDist(&ws.tmp_dist[0]);
+        ball_t.InsertEdge(v, u, added_nodes, ws);
         ball_t.UnsetTempDist();
       }
+      for (int w : added_nodes) IndexNode(w, ws);
       
       bool u_in_s = ball_s.HasNode(u), v_in_s = ball_s.HasNode(v);
       bool u_in_t = ball_t.HasNode(u), v_in_t = ball_t.HasNode(v);
       
       if (u_in_s){
-        UpdateDAGbyInsertion1(u, v);
+        UpdateDAGbyInsertion1(u, v, ws);
       } else if (v_in_t){
-        UpdateDAGbyInsertion2(u, v);
+        UpdateDAGbyInsertion2(u, v, ws);
       } else if (!u_in_s && !v_in_s && !u_in_t && !v_in_t){
-        UpdateDAGbyInsertion3(u, v);
+        UpdateDAGbyInsertion3(u, v, ws);
       }
     } else if (prq->Reach()){
       // cout << "REACH: " << source << " " << target << endl;
-      SubWeight();
-      is_connected = RecomputeIndex();
-      AddWeight();
+      SubWeight(ws);
+      is_connected = RecomputeIndex(ws);
+      AddWeight(ws);
     }
   }
 
+  bool HyperEdge::AffectedByInsertion(int u, int v) const {
+    if (source == target || !is_connected) return false;
+    // See UpdateDAGbyInsertion3; without a trade-off parameter a new shortest
+    // path has to leave ball_s or enter ball_t through an inserted edge.
+    assert(dch->tradeoff_param == 0);
+    return ball_s.HasNode(u) || ball_t.HasNode(v);
+  }
+
+  bool HyperEdge::CanReconnect() const {
+    return source != target && !is_connected && prq->Reach();
+  }
+
+  bool HyperEdge::AffectedByDeletion(int u, int v) const {
+    if (source == target || !is_connected) return false;
+    if (ball_s.HasNode(u) && ball_s.HasNode(v)) return true;
+    if (ball_t.HasNode(u) && ball_t.HasNode(v)) return true;
+    return dag.HasNode(u) && dag.HasNode(v);
+  }
+
+  void HyperEdge::CollectInsertedPaths(int u, int v, vector<int> &dag_nodes, Workspace &ws){
+    // UpdateDAGbyInsertion1, 2と同じく, (u, v)の先から反対側のボールまでを辿る.
+    // 届いた深さが予算より浅ければ距離が縮んでおり, CalcWeightがそれに気づく
+    vector<int> &inter_nodes = ws.inter_nodes[0];
+    inter_nodes.clear();
+    if (ball_s.HasNode(u) && (!ball_s.HasNode(v) || ball_s.GetDistance(u) + 1 == ball_s.GetDistance(v))){
+      int max_radius = distance - ball_s.GetDistance(u) - 1 - ball_t.GetRadius();
+      Explore(v, max_radius, ball_t, dch->G[0], dch->G[1], ws.tmp_dist[0], dag_nodes, inter_nodes, ws);
+      if (inter_nodes.empty()) return;
+      ws.frontier[0].assign(1, u);
+      ball_s.Trace(ws.frontier[0], dag_nodes, ws);
+      ball_t.Trace(inter_nodes   , dag_nodes, ws);
+      dag_nodes.push_back(u);
+    } else if (ball_t.HasNode(v) && (!ball_t.HasNode(u) || ball_t.GetDistance(v) + 1 == ball_t.GetDistance(u))){
+      int max_radius = distance - ball_t.GetDistance(v) - 1 - ball_s.GetRadius();
+      Explore(u, max_radius, ball_s, dch->G[1], dch->G[0], ws.tmp_dist[0], dag_nodes, inter_nodes, ws);
+      if (inter_nodes.empty()) return;
+      ws.frontier[0].assign(1, v);
+      ball_t.Trace(ws.frontier[0], dag_nodes, ws);
+      ball_s.Trace(inter_nodes   , dag_nodes, ws);
+      dag_nodes.push_back(v);
+    }
+    dag_nodes.insert(dag_nodes.end(), inter_nodes.begin(), inter_nodes.end());
+  }
+
+  void HyperEdge::Repair(const vector<pair<int, int> > &deleted, const vector<pair<int, int> > &inserted, Workspace &ws){
+    if (source == target) return;
+    if (!is_connected){
+      // 到達可能になった
+      is_connected = RecomputeIndex(ws);
+      AddWeight(ws);
+      return;
+    }
+    
+    vector<int> &added_nodes = ws.added_nodes;
+    added_nodes.clear();
+    ball_s.SetTempDist(&ws.tmp_dist[0]);
+    ball_s.Repair(deleted, inserted, false, added_nodes, ws);
+    ball_s.UnsetTempDist();
+    ball_t.SetTempDist(&ws.tmp_dist[0]);
+    ball_t.Repair(deleted, inserted, true, added_nodes, ws);
+    ball_t.UnsetTempDist();
+    for (int w : added_nodes) IndexNode(w, ws);
+    
+    // 距離が変わらなければ, 新しい最短路は元のDAGにあるか, 挿入された辺を通って見つかる
+    vector<int> &dag_nodes = ws.dag_nodes;
+    dag_nodes.clear();
+    for (size_t i = 0; i < dag.Size(); i++){
+      dag_nodes.push_back(dag.GetNode(i));
+    }
+    for (auto e : inserted){
+      CollectInsertedPaths(e.first, e.second, dag_nodes, ws);
+    }
+    sort(dag_nodes.begin(), dag_nodes.end());
+    dag_nodes.erase(unique(dag_nodes.begin(), dag_nodes.end()), dag_nodes.end());
+    
+    SubWeight(ws);
+    if (!CalcWeight(dag_nodes, ws, distance)){
+      // 距離が変わったか, 非連結になった
+      is_connected = RecomputeIndex(ws);
+    }
+    AddWeight(ws);
+  }
+  
   void HyperEdge::InsertNode(int u){
     // ここに来た時点でdch側はすでにグラフを更新している
     assert(0 <= u && size_t(u) < dch->G[0].size() && size_t(u) < dch->G[1].size());
@@ -639,70 +1163,79 @@ namespace betweenness_centrality {
   }
 
   void HyperEdge::
-  DeleteEdge(int u, int v){
+  DeleteEdge(int u, int v, Workspace &ws){
     if (source == target || !is_connected) return;
     
-    auto u_iter = scores.find(u);
-    auto v_iter = scores.find(v);
-    bool dag_update = u_iter != scores.end() && v_iter != scores.end() && dists[u] + 1 == dists[v];
+    int iu = dag.Find(u);
+    int iv = dag.Find(v);
+    bool dag_update = iu != -1 && iv != -1 && dag.InLayer(iv, dag.GetLayer(iu) + 1);
     
     if (dag_update){
       // DAGの更新が必要
-      if (Equal(u_iter->second, 1.0) && Equal(v_iter->second, 1.0)){
-        // sourceとtargetが非連結 <=> scores[u]=scores[v]=1
-        SubWeight();
-        is_connected = RecomputeIndex();
-        AddWeight();
+      if (Equal(dag.GetWeight(iu), 1.0) && Equal(dag.GetWeight(iv), 1.0)){
+        // sourceとtargetが非連結 <=> weight[u]=weight[v]=1
+        SubWeight(ws);
+        is_connected = RecomputeIndex(ws);
+        AddWeight(ws);
         // ボールの再計算も終わっている 
         return;
       } else {
+        // 距離は変わらない. vより下流とuより上流の経路数だけが変わる
         // DAG上の頂点集合が変わってしまうことに注意
-        SubWeight();
-        vector<int> dag_nodes;
-        for (auto p : scores){
-          dag_nodes.push_back(p.first);
-        }
-        CalcWeight(dag_nodes);
-        AddWeight();
+        SubWeight(ws);
+        ws.inter_nodes[0].assign(1, v);
+        ws.inter_nodes[1].assign(1, u);
+        RecountDAG(ws.inter_nodes[0], ws.inter_nodes[1], ws);
+        AddWeight(ws);
       }
     }
     
-    ball_s.SetTempDist(&dch->tmp_dist[0]);
-    ball_s.DeleteEdge(u, v);
+    ball_s.SetTempDist(&ws.tmp_dist[0]);
+    ball_s.DeleteEdge(u, v, ws);
     ball_s.UnsetTempDist();
 
-    ball_t.SetTempDist(&dch->tmp_dist[1]);
-    ball_t.DeleteEdge(v, u);
+    ball_t.SetTempDist(&ws.tmp_dist[1]);
+    ball_t.DeleteEdge(v, u, ws);
     ball_t.UnsetTempDist();
   }
 
-  void HyperEdge::DeleteNode(int u, const vector<int> &u_out, const vector<int> &u_in){
+  void HyperEdge::DeleteNode(int u, const vector<int> &u_out, const vector<int> &u_in, Workspace &ws){
     assert(dch->G[0][u].empty() && dch->G[1][u].empty());
     
-    auto u_iter = scores.find(u);
-    if (u_iter == scores.end()) return;
+    int iu = dag.Find(u);
+    if (iu == -1) return;
     
-    if (Equal(u_iter->second, 1.0)){
-      SubWeight();
-      is_connected = RecomputeIndex();
-      AddWeight();
+    if (Equal(dag.GetWeight(iu), 1.0)){
+      SubWeight(ws);
+      is_connected = RecomputeIndex(ws);
+      AddWeight(ws);
       return;
     } else {
       // DAG上で再計算、ただしuは通らない
-      SubWeight();
-      vector<int> dag_nodes;
-      for (auto p : scores){
-        if (p.first != u) dag_nodes.push_back(p.first);
+      int du = dag.GetLayer(iu);
+      vector<int> &down_nodes = ws.inter_nodes[0];
+      vector<int> &up_nodes   = ws.inter_nodes[1];
+      down_nodes.clear();
+      up_nodes.clear();
+      for (int w : u_out){
+        int j = dag.Find(w);
+        if (j != -1 && dag.InLayer(j, du + 1)) down_nodes.push_back(w);
+      }
+      for (int w : u_in){
+        int j = dag.Find(w);
+        if (j != -1 && dag.InLayer(j, du - 1)) up_nodes.push_back(w);
       }
-      CalcWeight(dag_nodes);
-      AddWeight();
+      SubWeight(ws);
+      dag.CountS(iu) = dag.CountT(iu) = 0;
+      RecountDAG(down_nodes, up_nodes, ws);
+      AddWeight(ws);
     }
-    ball_s.SetTempDist(&dch->tmp_dist[0]);
-    ball_s.DeleteNode(u, u_out, u_in);
+    ball_s.SetTempDist(&ws.tmp_dist[0]);
+    ball_s.DeleteNode(u, u_out, u_in, ws);
     ball_s.UnsetTempDist();
     
-    ball_t.SetTempDist(&dch->tmp_dist[1]);
-    ball_t.DeleteNode(u, u_in, u_out);
+    ball_t.SetTempDist(&ws.tmp_dist[1]);
+    ball_t.DeleteNode(u, u_in, u_out, ws);
     ball_t.UnsetTempDist();
   }
   
@@ -3,96 +3,346 @@
 
 #include "common.hpp"
 #include "special_purpose_reachability_index.hpp"
+#include "memory_pool.hpp"
+#include "traversal.hpp"
+#include "snapshot.hpp"
 #include "sparsehash/dense_hash_map"
+#include "sparsehash/dense_hash_set"
+#include <algorithm>
+#include <stdint.h>
 using std::vector;
 
 namespace betweenness_centrality {
 
-  template <typename T, typename E> using hash_map = google::dense_hash_map<T,E>;
+  // Buckets of the tables come from MemoryPool, so that they are recycled when hyper-edges are resampled.
+  template <typename T, typename E> using hash_map =
+    google::dense_hash_map<T, E, SPARSEHASH_HASH<T>, std::equal_to<T>, PoolAllocator<std::pair<const T, E> > >;
+  template <typename T> using hash_set =
+    google::dense_hash_set<T, SPARSEHASH_HASH<T>, std::equal_to<T>, PoolAllocator<T> >;
+  template <typename T> using pool_vector = std::vector<T, PoolAllocator<T> >;
   
   class DynamicCentralityHAY;
+
+  // Scratch arrays used while a hyper-edge is built or updated.
+  // Every thread that touches hyper-edges owns its own workspace.
+  struct Workspace {
+    vector<int>    tmp_dist[2];
+    vector<double> tmp_count[2];
+    vector<int>    tmp_passable;
+    
+    // Reused by the searches in hyper_edge.cpp, so that updates do not allocate.
+    FlatQueue<int> que[4];
+    FlatQueue<std::pair<int, int> > pair_que;
+    FlatHeap<std::pair<int, int> >  heap;
+    EpochVisited   visited;
+    vector<int>    frontier[2];
+    vector<int>    common_nodes;
+    vector<int>    dag_nodes;
+    vector<int>    inter_nodes[2];
+    vector<int>    added_nodes;
+    vector<std::pair<int, int> > ball_nodes;
+    // deleted and inserted edges of a batch that reach one hyper-edge
+    vector<std::pair<int, int> > batch_edges[2];
+    
+    // When set, score changes are logged into score_deltas instead of being
+    // applied to DynamicCentralityHAY::score, which other threads may share.
+    bool defer_scores;
+    vector<std::pair<int, double> > score_deltas;
+    // When set, score changes are dropped. PreCompute builds hyper-edges this
+    // way and adds their weights afterwards in the order of their ids, so that
+    // the scores do not depend on which thread built which hyper-edge.
+    bool skip_scores;
+    
+    // (vertex, hyper-edge id) pairs to be added to the inverted index, and
+    // hyper-edges that became disconnected. Merged by DynamicCentralityHAY.
+    vector<std::pair<int, int> > index_log;
+    vector<int> disconnected_log;
+    
+    Workspace() : defer_scores(false), skip_scores(false) {}
+    void Resize(size_t V);
+    void Clear();
+  };
+  
+  // Distances of the nodes of a ball from its center.
+  // Balls are mostly tiny, so their nodes are kept in a flat inline array that is
+  // scanned linearly; only a ball that outgrows it moves to a hash table.
+  class NodeDistanceMap {
+  public:
+    static const int kFlatCapacity = 16;
+    
+  private:
+    typedef hash_map<int, int> Table;
+    int    num_flat;
+    int    nodes[kFlatCapacity];
+    int    dists[kFlatCapacity];
+    Table *table;
+    
+    void ToTable();
+    void ToFlat();
+    
+  public:
+    NodeDistanceMap() : num_flat(0), table(nullptr) {}
+    ~NodeDistanceMap(){ Clear(); }
+    NodeDistanceMap(const NodeDistanceMap &) = delete;
+    NodeDistanceMap &operator=(const NodeDistanceMap &) = delete;
+    
+    inline size_t Size() const { return table != nullptr ? table->size() : num_flat; }
+    
+    inline const int *Find(int v) const {
+      if (table != nullptr){
+        auto iter = table->find(v);
+        return iter != table->end() ? &iter->second : nullptr;
+      }
+      for (int i = 0; i < num_flat; i++){
+        if (nodes[i] == v) return &dists[i];
+      }
+      return nullptr;
+    }
+    
+    inline void Set(int v, int d){
+      if (table == nullptr){
+        for (int i = 0; i < num_flat; i++){
+          if (nodes[i] == v){
+            dists[i] = d;
+            return;
+          }
+        }
+        if (num_flat < kFlatCapacity){
+          nodes[num_flat] = v;
+          dists[num_flat] = d;
+          num_flat++;
+          return;
+        }
+        ToTable();
+      }
+      (*table)[v] = d;
+    }
+    
+    inline void Erase(int v){
+      if (table != nullptr){
+        table->erase(v);
+        return;
+      }
+      for (int i = 0; i < num_flat; i++){
+        if (nodes[i] == v){
+          num_flat--;
+          nodes[i] = nodes[num_flat];
+          dists[i] = dists[num_flat];
+          return;
+        }
+      }
+    }
+    
+    // Replaces the contents with (vertex, distance) pairs of distinct vertices.
+    void Assign(const vector<std::pair<int, int> > &nodes);
+    // Removes every node whose distance is d.
+    void EraseDistance(int d);
+    void Clear();
+    // Releases the space of erased nodes, going back to the flat array when it fits.
+    void Compact();
+    
+    template <typename F> void ForEach(F f) const {
+      if (table != nullptr){
+        for (const auto &p : *table) f(p.first, p.second);
+      } else {
+        for (int i = 0; i < num_flat; i++) f(nodes[i], dists[i]);
+      }
+    }
+  };
   
   class Ball {
   private:
     int source;
     int radius;
     vector<int> *tmp_dist;
-    hash_map<int, int> distance;
+    NodeDistanceMap distance;
     vector<vector<int> >  *fadj;
     vector<vector<int> >  *badj;
     
   public:
-    Ball() : tmp_dist(nullptr) {
-      distance.set_empty_key(-1);
-      distance.set_deleted_key(-2);
-    }
+    Ball() : source(-1), radius(0), tmp_dist(nullptr), fadj(nullptr), badj(nullptr) {}
     void Build(const vector<std::pair<int, int> > &, vector<vector<int> > *, vector<vector<int> > *);
-    void Trace(const vector<int> &start_nodes, vector<int> &dag_nodes);
+    void Save(SnapshotWriter &out) const;
+    void Load(SnapshotReader &in, vector<vector<int> > *fadj, vector<vector<int> > *badj);
+    void Trace(const vector<int> &start_nodes, vector<int> &dag_nodes, Workspace &ws);
     void DecreaseRadius();
-    void InsertEdge(int u, int v);
-    void DeleteEdge(int u, int v);
+    void InsertEdge(int u, int v, vector<int> &added_nodes, Workspace &ws);
+    void DeleteEdge(int u, int v, Workspace &ws);
     void InsertNode(int v);  
-    void DeleteNode(int u, const vector<int> &u_out, const vector<int> &u_in);
+    void DeleteNode(int u, const vector<int> &u_out, const vector<int> &u_in, Workspace &ws);
+    // Fixes the distances after a batch of edge updates, which are all in the
+    // graph already. The edges are given as (u, v) of the graph; a ball around
+    // the target (backward) follows them as (v, u).
+    void Repair(const vector<std::pair<int, int> > &deleted, const vector<std::pair<int, int> > &inserted,
+                bool backward, vector<int> &added_nodes, Workspace &ws);
     void SetTempDist(vector<int> *tmp_dist){ this->tmp_dist = tmp_dist; }
     void UnsetTempDist(){ this->tmp_dist = nullptr; }
     
-    inline bool HasNode(int v) const { return distance.find(v) != distance.end();}
+    inline bool HasNode(int v) const { return distance.Find(v) != nullptr;}
     inline int GetDistance(int v) const {
-      const auto iter = distance.find(v);
-      assert(iter != distance.end());
-      return iter->second;
+      const int *d = distance.Find(v);
+      assert(d != nullptr);
+      return *d;
     }
     inline int GetRadius() const { return radius; }
-    inline size_t GetBallSize() const { return distance.size(); }
+    inline size_t GetBallSize() const { return distance.Size(); }
+    template <typename F> void ForEachNode(F f) const {
+      distance.ForEach([&](int v, int){ f(v); });
+    }
   private:  
     int FindParent(int v) const ;
-    void CollectChanges(const vector<int> &start_nodes, vector<int> &upd_nodes);
-    void FixChanges(const vector<int> &nodes);
+    void CollectChanges(const vector<int> &start_nodes, vector<int> &upd_nodes, Workspace &ws);
+    void FixChanges(const vector<int> &nodes, Workspace &ws);
   public:
     friend void Intersection(const Ball &, const Ball &, vector<int> &);
   };
   
+  // The shortest-path DAG between the source and the target of a hyper-edge,
+  // as flat arrays sorted by the distance from the source (the layer).
+  // Node i lies on count_s[i] * count_t[i] of the count_s[target] shortest paths.
+  class ShortestPathDAG {
+  public:
+    static const int kMaxScan = 8;
+    
+  private:
+    pool_vector<int>    nodes;
+    pool_vector<double> count_s;      // number of shortest paths from the source
+    pool_vector<double> count_t;      // number of shortest paths to the target
+    pool_vector<int>    layer_begin;  // nodes in layer d are [layer_begin[d], layer_begin[d + 1])
+    pool_vector<int>    slots;        // open addressing from vertex to position, -1 if empty
+    
+    inline size_t Slot(int v) const {
+      uint32_t h = uint32_t(v) * 2654435761u;
+      return (h ^ (h >> 16)) & (slots.size() - 1);
+    }
+    void BuildSlots();
+    
+  public:
+    // Keeps the candidates with dist_s[v] + dist_t[v] == distance, taking
+    // their distances and path counts from the arrays indexed by vertex.
+    void Assign(const vector<int> &candidates, int distance,
+                const vector<int> &dist_s, const vector<int> &dist_t,
+                const vector<double> &count_s, const vector<double> &count_t);
+    void Clear();
+    // Removes the nodes that no longer lie on any shortest path.
+    void EraseUnreachable();
+    void Save(SnapshotWriter &out) const;
+    void Load(SnapshotReader &in);
+    
+    inline size_t Size() const { return nodes.size(); }
+    inline int GetNode(size_t i) const { return nodes[i]; }
+    
+    // Position of v, or -1 if v is not in the DAG.
+    inline int Find(int v) const {
+      if (slots.empty()){
+        for (size_t i = 0; i < nodes.size(); i++){
+          if (nodes[i] == v) return i;
+        }
+        return -1;
+      }
+      for (size_t k = Slot(v); slots[k] != -1; k = (k + 1) & (slots.size() - 1)){
+        if (nodes[slots[k]] == v) return slots[k];
+      }
+      return -1;
+    }
+    inline bool HasNode(int v) const { return Find(v) != -1; }
+    
+    inline int GetNumLayers() const { return int(layer_begin.size()) - 1; }
+    inline int GetLayer(int i) const {
+      return std::upper_bound(layer_begin.begin(), layer_begin.end(), i) - layer_begin.begin() - 1;
+    }
+    inline bool InLayer(int i, int d) const {
+      return 0 <= d && d < GetNumLayers() && layer_begin[d] <= i && i < layer_begin[d + 1];
+    }
+    
+    inline double &CountS(int i){ return count_s[i]; }
+    inline double &CountT(int i){ return count_t[i]; }
+    inline double GetNumPaths() const { return count_s.back(); }
+    inline double GetWeight(int i) const { return count_s[i] * count_t[i] / GetNumPaths(); }
+  };
+  
   class HyperEdge {
 
   private: 
     bool is_connected;
+    int  id;
     int  source;
     int  target;
     int  distance;
     Ball ball_s;
     Ball ball_t;
-    hash_map<int, double> scores;
-    hash_map<int, int>    dists;
+    ShortestPathDAG       dag;
+    hash_set<int>         indexed_nodes; // vertices registered in the inverted index of dch
     DynamicCentralityHAY *dch;
+    // tells when the pair becomes reachable; held only while it is disconnected
     special_purpose_reachability_index::ReachabilityQuerier *prq;
     
   public:
-    HyperEdge(int s, int t, DynamicCentralityHAY *dch);
-    ~HyperEdge(){ if (source != target && is_connected) SubWeight(); };
-    void InsertEdge(int s, int t);
-    void DeleteEdge(int u, int v);
+    HyperEdge(int s, int t, int id, DynamicCentralityHAY *dch, Workspace &ws);
+    // Restores a hyper-edge written by Save. Its vertices are not indexed yet (see Reindex).
+    HyperEdge(SnapshotReader &in, int id, DynamicCentralityHAY *dch);
+    ~HyperEdge();
+    static void *operator new(size_t size){ return MemoryPool::Allocate(size); }
+    static void  operator delete(void *p, size_t size){ MemoryPool::Deallocate(p, size); }
+    void InsertEdge(int s, int t, Workspace &ws);
+    void DeleteEdge(int u, int v, Workspace &ws);
     void InsertNode(int u);
-    void DeleteNode(int u, const vector<int> &u_out, const vector<int> &u_in);
+    void DeleteNode(int u, const vector<int> &u_out, const vector<int> &u_in, Workspace &ws);
     
     inline int GetSource() const { return source; }
     inline int GetTarget() const { return target; }
     inline int ShortestPathLength() const { return distance; }
     inline bool IsConnected() const { return is_connected; }
-    inline int GetNumNodes() const { return scores.size(); }
+    inline int GetNumNodes() const { return dag.Size(); }
+    inline bool HasNode(int v) const {
+      return ball_s.HasNode(v) || ball_t.HasNode(v) || dag.HasNode(v);
+    }
+    
+    // Whether inserting/deleting (u, v) may change this hyper-edge, judged
+    // from its current balls and DAG. Used to coalesce batched updates.
+    bool AffectedByInsertion(int u, int v) const;
+    bool AffectedByDeletion(int u, int v) const;
+    // Whether a disconnected pair has become reachable.
+    bool CanReconnect() const;
+    // Brings the balls and the DAG up to date with the edges of a batch that
+    // reach this hyper-edge, and updates the scores. The DAG is rebuilt from
+    // scratch only if the distance or the connectivity of the pair changes.
+    void Repair(const vector<std::pair<int, int> > &deleted, const vector<std::pair<int, int> > &inserted, Workspace &ws);
+    
+    // Registers every vertex of the balls and the DAG under a new id.
+    void Reindex(int new_id, Workspace &ws);
+    inline void UnindexNode(int v) { indexed_nodes.erase(v); }
+    // Adds the weight of every DAG node to its score.
+    void AddWeight(Workspace &ws);
+    
+    // querier_id is the position of the querier of this hyper-edge in
+    // SpecialPurposeReachabilityIndex::GetQueriers(), or -1 if it has none.
+    void Save(SnapshotWriter &out, int querier_id) const;
+    inline const special_purpose_reachability_index::ReachabilityQuerier *GetQuerier() const { return prq; }
 
   private:
-    bool BidirectionalSearch(int s, int t);
-    void ComputeNumPaths(int s, const vector<vector<int> >  &adj, vector<int> &dist, vector<double> &count);
-    bool RecomputeIndex();
+    bool BidirectionalSearch(int s, int t, Workspace &ws);
+    void ComputeNumPaths(int s, const vector<vector<int> >  &adj, vector<int> &dist, vector<double> &count, const vector<int> &passable, FlatQueue<int> &que);
+    bool RecomputeIndex(Workspace &ws);
+    // Creates the querier if the pair is disconnected and gives it back otherwise.
+    void UpdateQuerier(Workspace &ws);
 
-    void UpdateDAGbyInsertion1(int u, int v);
-    void UpdateDAGbyInsertion2(int u, int v);
-    void UpdateDAGbyInsertion3(int u, int v);
-    
-    void CalcWeight();
-    void CalcWeight(const vector<int> &dag_nodes);
-    void AddWeight();
-    void SubWeight();
+    void UpdateDAGbyInsertion1(int u, int v, Workspace &ws);
+    void UpdateDAGbyInsertion2(int u, int v, Workspace &ws);
+    void UpdateDAGbyInsertion3(int u, int v, Workspace &ws);
+    
+    void CalcWeight(Workspace &ws);
+    // Returns false, leaving the DAG as it is, if expected_distance is given
+    // and dag_nodes do not join the pair at that distance.
+    bool CalcWeight(const vector<int> &dag_nodes, Workspace &ws, int expected_distance = -1);
+    // Adds the nodes of the new shortest paths through the inserted edge (u, v), if any.
+    void CollectInsertedPaths(int u, int v, vector<int> &dag_nodes, Workspace &ws);
+    void RecountPaths(const vector<int> &start_nodes, bool forward, Workspace &ws);
+    void RecountDAG(const vector<int> &down_nodes, const vector<int> &up_nodes, Workspace &ws);
+    void SubWeight(Workspace &ws);
+    void UpdateScore(int v, double delta, Workspace &ws);
+    void IndexNode(int v, Workspace &ws);
+    void IndexNodes(Workspace &ws);
   };
   
 
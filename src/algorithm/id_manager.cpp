@@ -1,5 +1,6 @@
 #include "id_manager.hpp"
 #include "common.hpp"
+#include "snapshot.hpp"
 #include <numeric>
 using namespace std;
 
@@ -78,3 +79,25 @@ int IDManager::SampleAlive() const {
 int IDManager::SampleDead() const {
   return !dead_ids.empty() ? dead_ids[rand() % dead_ids.size()] : -1;
 }
+
+int IDManager::SampleAlive(betweenness_centrality::Random &rng) const {
+  return !alive_ids.empty() ? alive_ids[rng.Uniform(alive_ids.size())] : -1;
+}
+
+int IDManager::SampleDead(betweenness_centrality::Random &rng) const {
+  return !dead_ids.empty() ? dead_ids[rng.Uniform(dead_ids.size())] : -1;
+}
+
+void IDManager::Save(betweenness_centrality::SnapshotWriter &out) const {
+  out.PutVector(alive_ids);
+  out.PutVector(dead_ids);
+  out.PutVector(pos_in_alive);
+  out.PutVector(pos_in_dead);
+}
+
+void IDManager::Load(betweenness_centrality::SnapshotReader &in){
+  in.GetVector(alive_ids);
+  in.GetVector(dead_ids);
+  in.GetVector(pos_in_alive);
+  in.GetVector(pos_in_dead);
+}
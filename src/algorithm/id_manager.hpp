@@ -3,8 +3,14 @@
 
 #include <vector>
 #include <cstdlib>
+#include "random.hpp"
 using std::vector;
 
+namespace betweenness_centrality {
+  class SnapshotWriter;
+  class SnapshotReader;
+}
+
 class IDManager {
   std::vector<int> alive_ids;
   std::vector<int> dead_ids;
@@ -17,9 +23,14 @@ public:
   bool MakeDead(int u);
   int SampleAlive() const ;
   int SampleDead() const ;
+  // same as above, but draw from rng instead of rand()
+  int SampleAlive(betweenness_centrality::Random &rng) const ;
+  int SampleDead(betweenness_centrality::Random &rng) const ;
   bool Full() const { return dead_ids.empty(); }
   size_t Size() const { return pos_in_alive.size(); }
   size_t NumAlive() const { return alive_ids.size(); }
+  void Save(betweenness_centrality::SnapshotWriter &out) const;
+  void Load(betweenness_centrality::SnapshotReader &in);
 };
 
 
@@ -0,0 +1,208 @@
+#include "memory_pool.hpp"
+#include "common.hpp"
+#include <mutex>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+using namespace std;
+
+namespace betweenness_centrality {
+
+  namespace {
+    const int    kMinShift    = 4;                       // 16 bytes
+    const int    kMaxShift    = 18;                      // 256 KiB
+    const int    kNumClasses  = kMaxShift - kMinShift + 1;
+    const size_t kSlabSize    = size_t(1) << 21;         // one huge page
+    const size_t kCacheBytes  = size_t(1) << 22;         // per class and thread
+    const size_t kRefillBytes = size_t(1) << 16;
+
+    struct FreeBlock {
+      FreeBlock *next;
+    };
+
+    struct FreeList {
+      FreeBlock *head;
+      size_t     size;
+      FreeList() : head(nullptr), size(0) {}
+
+      inline void Push(void *p){
+        FreeBlock *b = static_cast<FreeBlock*>(p);
+        b->next = head;
+        head = b;
+        size++;
+      }
+      inline void *Pop(){
+        FreeBlock *b = head;
+        head = b->next;
+        size--;
+        return b;
+      }
+      // Moves up to n blocks from the front of from to this list.
+      void Take(FreeList &from, size_t n){
+        for (; n > 0 && from.head != nullptr; n--) Push(from.Pop());
+      }
+    };
+
+    inline int SizeClass(size_t bytes){
+      int shift = kMinShift;
+      while ((size_t(1) << shift) < bytes) shift++;
+      return shift - kMinShift;
+    }
+    inline size_t ClassSize(int c){ return size_t(1) << (c + kMinShift); }
+
+    // Blocks given back by threads, and by threads that have exited.
+    struct SharedPool {
+      mutex          mtx;
+      FreeList       lists[kNumClasses];
+      atomic<size_t> reserved;
+      atomic<bool>   use_huge_pages;
+      SharedPool() : reserved(0), use_huge_pages(false) {}
+    };
+
+    SharedPool &Shared(){
+      // Never destroyed: thread caches flush into it on exit, possibly after static destruction began.
+      static SharedPool *shared = new SharedPool();
+      return *shared;
+    }
+
+    char *NewSlab(){
+      SharedPool &shared = Shared();
+      void *p = nullptr;
+      CHECK(posix_memalign(&p, kSlabSize, kSlabSize) == 0);
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+      if (shared.use_huge_pages) madvise(p, kSlabSize, MADV_HUGEPAGE);
+#endif
+      shared.reserved += kSlabSize;
+      return static_cast<char*>(p);
+    }
+
+    struct ThreadCache {
+      FreeList lists[kNumClasses];
+      char    *slab_curr;
+      char    *slab_end;
+      ThreadCache() : slab_curr(nullptr), slab_end(nullptr) {}
+
+      // Cuts the rest of the current slab into the largest blocks that fit.
+      void RetireSlab(){
+        for (int c = kNumClasses - 1; c >= 0; c--){
+          while (size_t(slab_end - slab_curr) >= ClassSize(c)){
+            lists[c].Push(slab_curr);
+            slab_curr += ClassSize(c);
+          }
+        }
+      }
+
+      void *Carve(int c){
+        if (size_t(slab_end - slab_curr) < ClassSize(c)){
+          RetireSlab();
+          slab_curr = NewSlab();
+          slab_end  = slab_curr + kSlabSize;
+        }
+        void *p = slab_curr;
+        slab_curr += ClassSize(c);
+        return p;
+      }
+
+      void Flush(){
+        RetireSlab();
+        SharedPool &shared = Shared();
+        lock_guard<mutex> lock(shared.mtx);
+        for (int c = 0; c < kNumClasses; c++){
+          shared.lists[c].Take(lists[c], lists[c].size);
+        }
+      }
+    };
+
+    // A plain pointer, so that it can still be read after the holder below has
+    // been destroyed at thread exit (e.g. by tables freed in static destructors).
+    thread_local ThreadCache *tls_cache  = nullptr;
+    thread_local bool         tls_exited = false;
+
+    struct ThreadCacheHolder {
+      ~ThreadCacheHolder(){
+        if (tls_cache != nullptr){
+          tls_cache->Flush();
+          delete tls_cache;
+          tls_cache = nullptr;
+        }
+        tls_exited = true;
+      }
+    };
+
+    ThreadCache *GetThreadCache(){
+      if (tls_cache == nullptr && !tls_exited){
+        thread_local ThreadCacheHolder holder;
+        tls_cache = new ThreadCache();
+      }
+      return tls_cache;
+    }
+  }
+
+  void *MemoryPool::Allocate(size_t bytes){
+    if (bytes > ClassSize(kNumClasses - 1)){
+      void *p = malloc(bytes);
+      if (p == nullptr) throw bad_alloc();
+      return p;
+    }
+
+    int c = SizeClass(bytes);
+    ThreadCache *cache = GetThreadCache();
+    if (cache == nullptr){
+      SharedPool &shared = Shared();
+      lock_guard<mutex> lock(shared.mtx);
+      if (shared.lists[c].head != nullptr) return shared.lists[c].Pop();
+      void *p = malloc(ClassSize(c));
+      if (p == nullptr) throw bad_alloc();
+      return p;
+    }
+
+    FreeList &list = cache->lists[c];
+    if (list.head == nullptr){
+      SharedPool &shared = Shared();
+      lock_guard<mutex> lock(shared.mtx);
+      list.Take(shared.lists[c], max<size_t>(1, kRefillBytes / ClassSize(c)));
+    }
+    return list.head != nullptr ? list.Pop() : cache->Carve(c);
+  }
+
+  void MemoryPool::Deallocate(void *p, size_t bytes){
+    if (p == nullptr) return;
+    if (bytes > ClassSize(kNumClasses - 1)){
+      free(p);
+      return;
+    }
+
+    int c = SizeClass(bytes);
+    ThreadCache *cache = GetThreadCache();
+    SharedPool &shared = Shared();
+    if (cache == nullptr){
+      lock_guard<mutex> lock(shared.mtx);
+      shared.lists[c].Push(p);
+      return;
+    }
+
+    FreeList &list = cache->lists[c];
+    list.Push(p);
+    size_t limit = max<size_t>(2, kCacheBytes / ClassSize(c));
+    if (list.size > limit){
+      // give half of them to the other threads
+      lock_guard<mutex> lock(shared.mtx);
+      shared.lists[c].Take(list, list.size / 2);
+    }
+  }
+
+  void MemoryPool::SetUseHugePages(bool use){
+    Shared().use_huge_pages = use;
+  }
+
+  bool MemoryPool::GetUseHugePages(){
+    return Shared().use_huge_pages;
+  }
+
+  size_t MemoryPool::GetReservedBytes(){
+    return Shared().reserved;
+  }
+}
@@ -0,0 +1,67 @@
+#ifndef MEMORY_POOL_H
+#define MEMORY_POOL_H
+
+#include <cstddef>
+#include <new>
+
+namespace betweenness_centrality {
+
+  // A size-class slab allocator for hyper-edges and the buckets of their tables.
+  // Blocks are carved from large slabs that are never returned to the system, and
+  // freed blocks are recycled through per-thread free lists (spilling over into a
+  // shared one), so resampling hyper-edges does not go through malloc/free and the
+  // resident set stays at its peak instead of fragmenting.
+  // Requests larger than the largest size class fall back to malloc.
+  class MemoryPool {
+  public:
+    static void *Allocate(size_t bytes);
+    static void  Deallocate(void *p, size_t bytes);
+
+    // Slabs allocated after this call are advised to be backed by
+    // transparent huge pages (Linux only, ignored elsewhere).
+    static void SetUseHugePages(bool use);
+    static bool GetUseHugePages();
+
+    // Bytes of slabs taken from the system so far.
+    static size_t GetReservedBytes();
+  };
+
+  // STL-style allocator on top of MemoryPool, usable with google::dense_hash_map.
+  template <typename T>
+  class PoolAllocator {
+  public:
+    typedef T         value_type;
+    typedef size_t    size_type;
+    typedef ptrdiff_t difference_type;
+    typedef T*        pointer;
+    typedef const T*  const_pointer;
+    typedef T&        reference;
+    typedef const T&  const_reference;
+
+    template <typename U> struct rebind { typedef PoolAllocator<U> other; };
+
+    PoolAllocator() {}
+    template <typename U> PoolAllocator(const PoolAllocator<U> &) {}
+
+    pointer address(reference r) const { return &r; }
+    const_pointer address(const_reference r) const { return &r; }
+
+    pointer allocate(size_type n, const void * = 0){
+      return static_cast<pointer>(MemoryPool::Allocate(n * sizeof(T)));
+    }
+    void deallocate(pointer p, size_type n){
+      MemoryPool::Deallocate(p, n * sizeof(T));
+    }
+    size_type max_size() const { return static_cast<size_type>(-1) / sizeof(T); }
+
+    void construct(pointer p, const T &val){ new(p) T(val); }
+    void destroy(pointer p){ p->~T(); }
+  };
+
+  template <typename T, typename U>
+  inline bool operator==(const PoolAllocator<T> &, const PoolAllocator<U> &){ return true; }
+  template <typename T, typename U>
+  inline bool operator!=(const PoolAllocator<T> &, const PoolAllocator<U> &){ return false; }
+}
+
+#endif /* MEMORY_POOL_H */
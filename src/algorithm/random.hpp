@@ -0,0 +1,42 @@
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <cstddef>
+#include <stdint.h>
+
+namespace betweenness_centrality {
+
+  // Small pseudo random generator (xorshift64*) whose whole state is one word,
+  // so that it can be saved in a snapshot or an update log and restored to
+  // replay the same sampling. Unlike rand(), it is not shared with other code.
+  class Random {
+  private:
+    uint64_t state;
+
+  public:
+    explicit Random(uint64_t seed = 0){ Seed(seed); }
+
+    // Spreads the seed over the state with splitmix64, so that close seeds give unrelated sequences.
+    inline void Seed(uint64_t seed){
+      uint64_t z = seed + 0x9E3779B97F4A7C15ull;
+      z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+      z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+      SetState(z ^ (z >> 31));
+    }
+    inline uint64_t GetState() const { return state; }
+    inline void SetState(uint64_t x){ state = x != 0 ? x : 1; }
+
+    inline uint32_t Next(){
+      state ^= state >> 12;
+      state ^= state << 25;
+      state ^= state >> 27;
+      return (state * 0x2545F4914F6CDD1Dull) >> 32;
+    }
+    // An integer in [0, n); n > 0 is assumed.
+    inline size_t Uniform(size_t n){ return Next() % n; }
+    // A real number in [0, 1].
+    inline double UniformReal(){ return Next() / 4294967295.0; }
+  };
+}
+
+#endif /* RANDOM_H */
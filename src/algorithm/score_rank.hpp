@@ -0,0 +1,89 @@
+#ifndef SCORE_RANK_H
+#define SCORE_RANK_H
+
+#include <vector>
+#include <utility>
+#include <limits>
+#include <climits>
+#include <functional>
+#include <ext/pb_ds/assoc_container.hpp>
+#include <ext/pb_ds/tree_policy.hpp>
+#include "common.hpp"
+using std::vector;
+
+namespace betweenness_centrality {
+
+  // Order-statistics tree over the scores of vertices, which counts the
+  // vertices with a larger score than a given one in O(log n). As in
+  // ScoreTree, Set only records the new score and marks the vertex, and
+  // Flush moves the marked vertices in the tree. Inactive vertices are not counted.
+  class ScoreRank {
+  private:
+    // (-score, id), so that the vertices with larger scores come first
+    typedef std::pair<double, int> Key;
+    typedef __gnu_pbds::tree<Key, __gnu_pbds::null_type, std::less<Key>, __gnu_pbds::rb_tree_tag,
+                             __gnu_pbds::tree_order_statistics_node_update> OrderedSet;
+
+    OrderedSet     keys;
+    vector<double> score;   // latest score of each id, or -inf if inactive
+    vector<double> in_keys; // score of each id in keys, or -inf if absent
+    vector<int>    dirty;
+    vector<char>   is_dirty;
+
+    static inline double Inactive(){ return -std::numeric_limits<double>::infinity(); }
+
+  public:
+    // Grows to at least n ids; the new ones are inactive.
+    void Resize(size_t n){
+      if (n <= score.size()) return;
+      score.resize(n, Inactive());
+      in_keys.resize(n, Inactive());
+      is_dirty.resize(n, false);
+    }
+
+    // Makes every id in [0, scores.size()) active with the given score.
+    // Like the other changes, they reach the tree at the next Flush.
+    void Assign(const vector<double> &scores){
+      Clear();
+      Resize(scores.size());
+      for (size_t i = 0; i < scores.size(); i++) Set(i, scores[i]);
+    }
+
+    void Clear(){
+      keys.clear();
+      score.clear();
+      in_keys.clear();
+      dirty.clear();
+      is_dirty.clear();
+    }
+
+    inline void Set(int i, double s){
+      score[i] = s;
+      if (!is_dirty[i]){
+        is_dirty[i] = true;
+        dirty.push_back(i);
+      }
+    }
+    inline void Deactivate(int i){ Set(i, Inactive()); }
+    inline bool IsActive(int i) const { return score[i] != Inactive(); }
+
+    void Flush(){
+      for (int i : dirty){
+        is_dirty[i] = false;
+        if (in_keys[i] != Inactive()) keys.erase(Key(-in_keys[i], i));
+        if (score[i]   != Inactive()) keys.insert(Key(-score[i], i));
+        in_keys[i] = score[i];
+      }
+      dirty.clear();
+    }
+
+    // Number of active ids, and of those whose score is larger than s. The tree must be flushed.
+    size_t Size() const { return keys.size(); }
+    size_t NumGreater(double s) const {
+      CHECK(dirty.empty());
+      return keys.order_of_key(Key(-s, INT_MIN));
+    }
+  };
+}
+
+#endif /* SCORE_RANK_H */
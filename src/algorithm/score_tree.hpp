@@ -0,0 +1,130 @@
+#ifndef SCORE_TREE_H
+#define SCORE_TREE_H
+
+#include <vector>
+#include <queue>
+#include <limits>
+#include <cstddef>
+#include "common.hpp"
+using std::vector;
+
+namespace betweenness_centrality {
+
+  // Tournament tree over the scores of vertices, which lists the k largest
+  // ones in O(k log n). Set only records the new score and marks the vertex,
+  // so that the many small changes of an update stay O(1) each; Flush then
+  // replays the marked vertices up the tree (or rebuilds it if that is cheaper).
+  // Vertices that are not active (new ones, and removed ones) are never listed.
+  // Ties are broken by the smaller id.
+  class ScoreTree {
+  private:
+    size_t         num_leaves; // a power of two
+    vector<double> key;        // score of each leaf, or -inf if inactive
+    vector<int>    win;        // win[x]: leaf with the best key below node x, leaves are [num_leaves, 2 * num_leaves)
+    vector<int>    dirty;
+    vector<char>   is_dirty;
+
+    static inline double Inactive(){ return -std::numeric_limits<double>::infinity(); }
+
+    inline bool Better(int a, int b) const {
+      return key[a] > key[b] || (key[a] == key[b] && a < b);
+    }
+    inline void Pull(size_t x){
+      int l = win[2 * x], r = win[2 * x + 1];
+      win[x] = Better(l, r) ? l : r;
+    }
+    inline void MarkDirty(int i){
+      if (!is_dirty[i]){
+        is_dirty[i] = true;
+        dirty.push_back(i);
+      }
+    }
+
+  public:
+    ScoreTree() : num_leaves(1), key(1, Inactive()), win(2, 0), is_dirty(1, false) {}
+
+    // Grows to at least n ids; the new ones are inactive.
+    void Resize(size_t n){
+      if (n <= num_leaves) return;
+      while (num_leaves < n) num_leaves *= 2;
+      key.resize(num_leaves, Inactive());
+      is_dirty.resize(num_leaves, false);
+      Rebuild();
+    }
+
+    // Makes every id in [0, scores.size()) active with the given score.
+    void Assign(const vector<double> &scores){
+      Clear();
+      Resize(scores.size());
+      for (size_t i = 0; i < scores.size(); i++) key[i] = scores[i];
+      Rebuild();
+    }
+
+    void Clear(){
+      num_leaves = 1;
+      key.assign(1, Inactive());
+      win.assign(2, 0);
+      dirty.clear();
+      is_dirty.assign(1, false);
+    }
+
+    inline void Set(int i, double score){
+      key[i] = score;
+      MarkDirty(i);
+    }
+    inline void Deactivate(int i){ Set(i, Inactive()); }
+    inline bool IsActive(int i) const { return key[i] != Inactive(); }
+
+    void Flush(){
+      size_t depth = 1;
+      while ((size_t(1) << depth) < num_leaves) depth++;
+      if (dirty.size() * depth >= num_leaves){
+        Rebuild();
+        return;
+      }
+      for (int i : dirty){
+        is_dirty[i] = false;
+        for (size_t x = (num_leaves + i) / 2; x >= 1; x /= 2) Pull(x);
+      }
+      dirty.clear();
+    }
+
+    // Appends to res the active ids with the k largest scores, in decreasing
+    // order of score. The tree must be flushed.
+    void TopK(size_t k, vector<int> &res) const {
+      CHECK(dirty.empty());
+      auto cmp = [&](size_t x, size_t y){ return Better(win[y], win[x]); };
+      std::priority_queue<size_t, vector<size_t>, decltype(cmp)> que(cmp);
+      que.push(1);
+      for (size_t n = 0; n < k && !que.empty(); n++){
+        size_t x = que.top();
+        que.pop();
+        int w = win[x];
+        if (key[w] == Inactive()) break;
+        res.push_back(w);
+        // the rest of the subtree of x is covered by the siblings of its path to w
+        while (x < num_leaves){
+          size_t l = 2 * x, r = 2 * x + 1;
+          if (win[l] == w){
+            que.push(r);
+            x = l;
+          } else {
+            que.push(l);
+            x = r;
+          }
+        }
+      }
+    }
+
+  private:
+    void Rebuild(){
+      win.resize(2 * num_leaves);
+      for (size_t i = 0; i < num_leaves; i++) win[num_leaves + i] = i;
+      for (size_t x = num_leaves - 1; x >= 1; x--) Pull(x);
+      for (int i : dirty) is_dirty[i] = false;
+      dirty.clear();
+    }
+  };
+}
+
+#endif /* SCORE_TREE_H */
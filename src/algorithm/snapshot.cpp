@@ -0,0 +1,131 @@
+#include "snapshot.hpp"
+#include "common.hpp"
+#include <unistd.h>
+using namespace std;
+
+namespace betweenness_centrality {
+
+  namespace {
+    const char     kMagic[8]    = {'H', 'A', 'Y', 'S', 'N', 'A', 'P', '\0'};
+    const size_t   kBufferSize  = size_t(1) << 22;
+    const uint64_t kHashInit    = 14695981039346656037ull;
+    const uint64_t kHashPrime   = 1099511628211ull;
+
+    struct Header {
+      char     magic[8];
+      uint32_t version;
+      uint32_t reserved;
+      uint64_t payload_size;
+      uint64_t checksum;
+    };
+
+    // FNV-1a over 64-bit words, then over the remaining bytes.
+    // Every call but the last must be given a multiple of 8 bytes.
+    uint64_t UpdateChecksum(uint64_t h, const char *p, size_t n){
+      size_t i = 0;
+      for (; i + 8 <= n; i += 8){
+        uint64_t w;
+        memcpy(&w, p + i, 8);
+        h = (h ^ w) * kHashPrime;
+      }
+      for (; i < n; i++){
+        h = (h ^ (unsigned char)p[i]) * kHashPrime;
+      }
+      return h;
+    }
+  }
+
+  uint64_t Checksum(const void *p, size_t n){
+    return UpdateChecksum(kHashInit, static_cast<const char*>(p), n);
+  }
+
+  SnapshotWriter::SnapshotWriter(const string &path)
+    : fp(nullptr), buffer(kBufferSize), buffer_size(0), payload_size(0), checksum(kHashInit), failed(false)
+  {
+    fp = fopen(path.c_str(), "wb");
+    if (fp == nullptr){
+      failed = true;
+      return;
+    }
+    // the header is filled in by Close
+    Header header = Header();
+    failed = fwrite(&header, sizeof(header), 1, fp) != 1;
+  }
+
+  SnapshotWriter::~SnapshotWriter(){
+    if (fp != nullptr) fclose(fp);
+  }
+
+  void SnapshotWriter::Flush(){
+    if (!failed && buffer_size > 0){
+      checksum = UpdateChecksum(checksum, buffer.data(), buffer_size);
+      failed   = fwrite(buffer.data(), 1, buffer_size, fp) != buffer_size;
+    }
+    buffer_size = 0;
+  }
+
+  void SnapshotWriter::PutBytes(const void *p, size_t n){
+    const char *src = static_cast<const char*>(p);
+    payload_size += n;
+    while (n > 0){
+      size_t m = min(n, kBufferSize - buffer_size);
+      memcpy(buffer.data() + buffer_size, src, m);
+      buffer_size += m;
+      src += m;
+      n   -= m;
+      if (buffer_size == kBufferSize) Flush();
+    }
+  }
+
+  bool SnapshotWriter::Close(){
+    if (fp == nullptr) return false;
+    Flush();
+
+    Header header = Header();
+    memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version      = kSnapshotVersion;
+    header.payload_size = payload_size;
+    header.checksum     = checksum;
+    if (!failed){
+      failed = fseek(fp, 0, SEEK_SET) != 0 || fwrite(&header, sizeof(header), 1, fp) != 1 ||
+        fflush(fp) != 0 || fsync(fileno(fp)) != 0;
+    }
+    failed |= fclose(fp) != 0;
+    fp = nullptr;
+    return !failed;
+  }
+
+  SnapshotReader::SnapshotReader(const string &path) : pos(0), failed(true) {
+    FILE *fp = fopen(path.c_str(), "rb");
+    if (fp == nullptr) return;
+
+    Header header;
+    if (fread(&header, sizeof(header), 1, fp) == 1 &&
+        memcmp(header.magic, kMagic, sizeof(kMagic)) == 0 &&
+        header.version == kSnapshotVersion){
+      // compare with the size of the file first, so that a broken header does not make us allocate a lot
+      long begin = ftell(fp);
+      if (fseek(fp, 0, SEEK_END) == 0 && uint64_t(ftell(fp) - begin) == header.payload_size &&
+          fseek(fp, begin, SEEK_SET) == 0){
+        data.resize(header.payload_size);
+        if (fread(data.data(), 1, data.size(), fp) == data.size() &&
+            Checksum(data.data(), data.size()) == header.checksum){
+          failed = false;
+        }
+      }
+    }
+    fclose(fp);
+    if (failed) data.clear();
+  }
+
+  void SnapshotReader::GetBytes(void *p, size_t n){
+    if (n == 0) return;
+    if (failed || n > data.size() - pos){
+      failed = true;
+      memset(p, 0, n);
+      return;
+    }
+    memcpy(p, data.data() + pos, n);
+    pos += n;
+  }
+}
@@ -0,0 +1,87 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstring>
+#include <stdint.h>
+using std::vector;
+
+namespace betweenness_centrality {
+
+  // Binary snapshots of an index. A file is a fixed header (magic, format
+  // version, payload size and checksum) followed by the payload. Values are
+  // stored as their raw bytes, so a snapshot is only read back on a machine
+  // with the same endianness and type sizes as the one that wrote it.
+  // Bump kSnapshotVersion whenever the layout of the payload changes.
+  const uint32_t kSnapshotVersion = 4;
+
+  // Checksum of n bytes, as stored in the header of a snapshot.
+  uint64_t Checksum(const void *p, size_t n);
+
+  // Streams the payload to the file through a fixed buffer.
+  class SnapshotWriter {
+  private:
+    FILE       *fp;
+    vector<char> buffer;
+    size_t      buffer_size;
+    uint64_t    payload_size;
+    uint64_t    checksum;
+    bool        failed;
+
+    void Flush();
+
+  public:
+    explicit SnapshotWriter(const std::string &path);
+    ~SnapshotWriter();
+    SnapshotWriter(const SnapshotWriter &) = delete;
+    SnapshotWriter &operator=(const SnapshotWriter &) = delete;
+
+    void PutBytes(const void *p, size_t n);
+    template <typename T> void Put(const T &x){ PutBytes(&x, sizeof(T)); }
+    template <typename T, typename A> void PutVector(const std::vector<T, A> &v){
+      Put<uint64_t>(v.size());
+      PutBytes(v.data(), v.size() * sizeof(T));
+    }
+
+    // Writes the header, flushes the file to the disk and closes it.
+    // Returns false if anything could not be written.
+    bool Close();
+  };
+
+  // Reads the whole payload with one read and verifies it before anything is parsed.
+  class SnapshotReader {
+  private:
+    vector<char> data;
+    size_t       pos;
+    bool         failed;
+
+  public:
+    explicit SnapshotReader(const std::string &path);
+
+    // Whether the file is missing or not a valid snapshot, or a read ran past the end.
+    inline bool Failed() const { return failed; }
+    inline bool AtEnd() const { return pos == data.size(); }
+    // Marks the snapshot as not valid, for a value that the caller cannot accept.
+    inline void SetFailed(){ failed = true; }
+
+    void GetBytes(void *p, size_t n);
+    template <typename T> T Get(){
+      T x = T();
+      GetBytes(&x, sizeof(T));
+      return x;
+    }
+    template <typename T, typename A> void GetVector(std::vector<T, A> &v){
+      uint64_t n = Get<uint64_t>();
+      if (n > (data.size() - pos) / sizeof(T)){
+        failed = true;
+        n = 0;
+      }
+      v.resize(n);
+      GetBytes(v.data(), n * sizeof(T));
+    }
+  };
+}
+
+#endif /* SNAPSHOT_H */
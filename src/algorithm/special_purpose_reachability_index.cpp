@@ -1,18 +1,60 @@
 #include "special_purpose_reachability_index.hpp"
 #include "common.hpp"
 #include <cassert>
-#include <queue>
+#include <algorithm>
 using namespace std;
 
 namespace betweenness_centrality {
   namespace special_purpose_reachability_index {
-    inline void SetBit(int &number, int pos, bool bit){
-      number &= ~(1 << pos);
-      number |= (int(bit) << pos);
+    // Numbers the strongly connected components of the graph with Tarjan's
+    // algorithm, without recursion. Returns the number of components.
+    int StronglyConnectedComponents(const vector<vector<int> > &adj, vector<int> &comp){
+      int n = adj.size();
+      vector<int> order(n, -1), low(n), pos(n, 0);
+      vector<int> path, stack;
+      comp.assign(n, -1);
+      int num_comps = 0, num_visited = 0;
+      for (int r = 0; r < n; r++){
+        if (order[r] != -1) continue;
+        order[r] = low[r] = num_visited++;
+        path.push_back(r);
+        stack.push_back(r);
+        while (!path.empty()){
+          int v = path.back();
+          if ((size_t)pos[v] < adj[v].size()){
+            int w = adj[v][pos[v]++];
+            if (order[w] == -1){
+              order[w] = low[w] = num_visited++;
+              path.push_back(w);
+              stack.push_back(w);
+            } else if (comp[w] == -1){
+              low[v] = min(low[v], order[w]);
+            }
+            continue;
+          }
+          path.pop_back();
+          if (!path.empty()) low[path.back()] = min(low[path.back()], low[v]);
+          if (low[v] == order[v]){
+            int w;
+            do {
+              w = stack.back(); stack.pop_back();
+              comp[w] = num_comps;
+            } while (w != v);
+            num_comps++;
+          }
+        }
+      }
+      return num_comps;
+    }
+
+    void PruneCounts::Add(const PruneCounts &other){
+      for (size_t k = 0; k < hits.size() && k < other.hits.size(); k++) hits[k] += other.hits[k];
+      tests += other.tests;
     }
 
-    inline bool GetBit(int number, int pos){
-      return (number >> pos) & 1;
+    void PruneCounts::Clear(){
+      fill(hits.begin(), hits.end(), 0);
+      tests = 0;
     }
   
     DynamicSPT::DynamicSPT(int r, vector<vector<int> >  *fadj, vector<vector<int> >  *badj) : root(r), fadj(fadj), badj(badj)
@@ -23,6 +65,18 @@ namespace betweenness_centrality {
       Build();
     }
 
+    DynamicSPT::DynamicSPT(SnapshotReader &in, vector<vector<int> >  *fadj, vector<vector<int> >  *badj) : fadj(fadj), badj(badj)
+    {
+      root = in.Get<int>();
+      in.GetVector(curr_dist);
+      next_dist.resize(curr_dist.size(), -1);
+    }
+
+    void DynamicSPT::Save(SnapshotWriter &out) const {
+      out.Put(root);
+      out.PutVector(curr_dist);
+    }
+
     void DynamicSPT::ChangeRoot(int new_root){
       vector<int> old_dist(curr_dist);
       fill(curr_dist.begin(), curr_dist.end(), INF);
@@ -35,21 +89,21 @@ namespace betweenness_centrality {
     void DynamicSPT::InsertEdge(int u, int v){
       chg_nodes.clear();
     
-      queue<int> que;
+      que.Clear();
       CHECK(ValidNode(u) && ValidNode(v));
     
       if (curr_dist[v] > curr_dist[u] + 1){
         curr_dist[v] = curr_dist[u] + 1;
-        que.push(v);
+        que.Push(v);
         chg_nodes.push_back(v);
       }
     
-      while (!que.empty()){
-        int v = que.front(); que.pop();
+      while (!que.Empty()){
+        int v = que.Pop();
         for (int w : fadj->at(v)){
           if (curr_dist[w] > curr_dist[v] + 1){
             curr_dist[w] = curr_dist[v] + 1;
-            que.push(w);
+            que.Push(w);
             chg_nodes.push_back(w);
           }
         }
@@ -65,10 +119,10 @@ namespace betweenness_centrality {
       CHECK(ValidNode(u) && ValidNode(v));
     
       if (curr_dist[v] == curr_dist[u] + 1){
-        vector<int> upd_nodes;
-        CollectChanges({v}, upd_nodes);
-        FixChanges(upd_nodes);
+        start_nodes.assign(1, v);
         upd_nodes.clear();
+        CollectChanges(start_nodes, upd_nodes);
+        FixChanges(upd_nodes);
       }
     }
 
@@ -82,8 +136,8 @@ namespace betweenness_centrality {
       CHECK(ValidNode(u) && fadj->at(u).empty() && badj->at(u).empty());
     
       if (curr_dist[u] < INF){
-        vector<int> start_nodes;
-        vector<int> upd_nodes;
+        start_nodes.clear();
+        upd_nodes.clear();
         for (int v : u_out){
           if (curr_dist[u] + 1 == curr_dist[v]) start_nodes.push_back(v);
         }
@@ -96,15 +150,15 @@ namespace betweenness_centrality {
     }
     
     void DynamicSPT::Build(){
-      queue<int> que;
+      que.Clear();
       curr_dist[root] = 0;
-      que.push(root);
-      while (!que.empty()){
-        int v = que.front(); que.pop();
+      que.Push(root);
+      while (!que.Empty()){
+        int v = que.Pop();
         for (int w : fadj->at(v)){
           if (curr_dist[w] == INF){
             curr_dist[w] = curr_dist[v] + 1;
-            que.push(w);
+            que.Push(w);
           }
         }
       }
@@ -123,17 +177,17 @@ namespace betweenness_centrality {
     }
 
     void DynamicSPT::CollectChanges(const vector<int> &start_nodes, vector<int> &upd_nodes){
-      queue<int> que;
+      que.Clear();
       for (int v : start_nodes){
         if (FindParent(v) == -1){
-          que.push(v);
+          que.Push(v);
           next_dist[v] = INF;
           upd_nodes.push_back(v);
         }
       }
       
-      while (!que.empty()){
-        int v  = que.front(); que.pop(); 
+      while (!que.Empty()){
+        int v  = que.Pop(); 
         for (int w : fadj->at(v)){
           if (next_dist[w] != -1 || curr_dist[w] != curr_dist[v] + 1) continue;
 
@@ -141,7 +195,7 @@ namespace betweenness_centrality {
           upd_nodes.push_back(w);
           if (FindParent(w) == -1){
             next_dist[w] = INF;
-            que.push(w);
+            que.Push(w);
           }
         }
       }
@@ -149,8 +203,8 @@ namespace betweenness_centrality {
 
     void DynamicSPT::FixChanges(const vector<int> &upd_nodes){
       // step 3.a
-      typedef pair<int, int> P;
-      priority_queue<P, vector<P>, greater<P> > que;
+      FlatHeap<pair<int, int> > &que = heap;
+      que.Clear();
     
       for (int v : upd_nodes){
         if (next_dist[v] > curr_dist[v]){
@@ -159,19 +213,19 @@ namespace betweenness_centrality {
               next_dist[v] = min(curr_dist[w] + 1, next_dist[v]);
             }
           }
-          que.push(make_pair(next_dist[v], v));
+          que.Push(make_pair(next_dist[v], v));
         }
       }
     
       // Step 3.b
-      while (!que.empty()){
-        int d = que.top().first;
-        int v = que.top().second; que.pop();
+      while (!que.Empty()){
+        int d = que.Top().first;
+        int v = que.Top().second; que.Pop();
         if (d > next_dist[v]) continue;
         for (int w : fadj->at(v)){
           if (next_dist[w] > curr_dist[w] && next_dist[v] + 1 < next_dist[w]){
             next_dist[w] = next_dist[v] + 1;
-            que.push(make_pair(next_dist[w], w));
+            que.Push(make_pair(next_dist[w], w));
           }
         }
       }
@@ -188,31 +242,68 @@ namespace betweenness_centrality {
                                              int target,
                                              vector<vector<int> > *fadj,
                                              vector<vector<int> > *badj,
-                                             SpecialPurposeReachabilityIndex *spr_index)
-      : source(source), target(target), fadj(fadj), badj(badj), spr_index(spr_index)
+                                             SpecialPurposeReachabilityIndex *spr_index,
+                                             FlatQueue<int> &que,
+                                             PruneCounts &counts)
+      : pos(0), source(source), target(target), fadj(fadj), badj(badj), spr_index(spr_index)
     {
       distance.set_empty_key(-1);
       distance.set_deleted_key(-2);
-      Build();
+      Build(que, counts);
       source_in_mask  = spr_index->GetInMask(source);
       source_out_mask = spr_index->GetOutMask(source);
       target_in_mask  = spr_index->GetInMask(target);
       target_out_mask = spr_index->GetOutMask(target);
     }
 
-    void ReachabilityQuerier::Build(){
+    ReachabilityQuerier::ReachabilityQuerier(SnapshotReader &in,
+                                             vector<vector<int> > *fadj,
+                                             vector<vector<int> > *badj,
+                                             SpecialPurposeReachabilityIndex *spr_index)
+      : pos(0), fadj(fadj), badj(badj), spr_index(spr_index)
+    {
+      distance.set_empty_key(-1);
+      distance.set_deleted_key(-2);
+      source          = in.Get<int>();
+      target          = in.Get<int>();
+      source_in_mask  = in.Get<ReachMask>();
+      source_out_mask = in.Get<ReachMask>();
+      target_in_mask  = in.Get<ReachMask>();
+      target_out_mask = in.Get<ReachMask>();
+      
+      vector<pair<int, int> > nodes;
+      in.GetVector(nodes);
+      distance.resize(nodes.size());
+      for (const auto &p : nodes) distance[p.fst] = p.snd;
+    }
+
+    void ReachabilityQuerier::Save(SnapshotWriter &out) const {
+      out.Put(source);
+      out.Put(target);
+      out.Put(source_in_mask);
+      out.Put(source_out_mask);
+      out.Put(target_in_mask);
+      out.Put(target_out_mask);
+      out.PutVector(vector<pair<int, int> >(distance.begin(), distance.end()));
+    }
+
+    void ReachabilityQuerier::Build(QuerierScratch &ws){
+      Build(ws.que, ws.counts);
+    }
+
+    void ReachabilityQuerier::Build(FlatQueue<int> &que, PruneCounts &counts){
       distance.clear();
       if (!ReachByTrees()){
-        queue<int> que;
-        que.push(source);
+        que.Clear();
+        que.Push(source);
         distance[source] = 0;
-        while (!que.empty()){
-          int v = que.front(); que.pop();
+        while (!que.Empty()){
+          int v = que.Pop();
           int d = distance[v];
           for (int w : fadj->at(v)){
-            if (!this->Prune(w) && distance.find(w) == distance.end()){
+            if (!this->Prune(w, counts) && distance.find(w) == distance.end()){
               distance[w] = d + 1;
-              que.push(w);
+              que.Push(w);
             }
           }
         }
@@ -220,8 +311,15 @@ namespace betweenness_centrality {
       UpdateMask();
     }
 
-    void ReachabilityQuerier::InsertEdge(int u, int v){
-      bool prev_tree_reach = (bool)(source_in_mask & target_out_mask);
+    bool ReachabilityQuerier::Prune(int v, PruneCounts &counts) const {
+      counts.tests++;
+      if (!Prune(v)) return false;
+      spr_index->GetOutMask(v).AndNot(spr_index->GetOutMask(target)).ForEachBit([&](int k){ counts.hits[k]++; });
+      return true;
+    }
+
+    void ReachabilityQuerier::InsertEdge(int u, int v, QuerierScratch &ws){
+      bool prev_tree_reach = source_in_mask.Intersects(target_out_mask);
       bool mask_change     = TargetMaskChanged();
       UpdateMask();
     
@@ -229,21 +327,22 @@ namespace betweenness_centrality {
         distance.clear();
       } else if (mask_change || prev_tree_reach){
         assert(!prev_tree_reach);
-        this->Build();
+        this->Build(ws);
       } else if (distance.find(u) != distance.end()){
-        queue<pair<int, int> > que;
+        FlatQueue<pair<int, int> > &que = ws.pair_que;
+        que.Clear();
         if (GetDistance(v) > GetDistance(u) + 1){
           distance[v] = GetDistance(u) + 1;
-          que.push(make_pair(v, distance[v]));
+          que.Push(make_pair(v, distance[v]));
           // change_vs_ei++;
         }
-        while (!que.empty()){
-          int v = que.front().first;
-          int d = que.front().second; que.pop();
+        while (!que.Empty()){
+          int v = que.Front().first;
+          int d = que.Front().second; que.Pop();
           for (int w : fadj->at(v)){
-            if (!this->Prune(w) && GetDistance(w) > d + 1){
+            if (!this->Prune(w, ws.counts) && GetDistance(w) > d + 1){
               distance[w] = d + 1;
-              que.push(make_pair(w, d + 1));
+              que.Push(make_pair(w, d + 1));
               // change_vs_ei++;
             }
           }
@@ -251,9 +350,7 @@ namespace betweenness_centrality {
       }
     }
 
-    int ReachabilityQuerier::FindParent(int v) const {
-      const auto &temp_dist = spr_index->temp_array;
-
+    int ReachabilityQuerier::FindParent(int v, const vector<int> &temp_dist) const {
       int dv = GetDistance(v);
     
       for (int w : badj->at(v)){
@@ -265,27 +362,28 @@ namespace betweenness_centrality {
       return -1;
     }
 
-    void ReachabilityQuerier::CollectChanges(const vector<int> &start_nodes, vector<int> &upd_nodes){
-      auto &temp_dist = spr_index->temp_array;
+    void ReachabilityQuerier::CollectChanges(const vector<int> &start_nodes, vector<int> &upd_nodes, QuerierScratch &ws){
+      auto &temp_dist = ws.temp_array;
     
-      queue<int>  que;
+      FlatQueue<int> &que = ws.que;
+      que.Clear();
       for (int v : start_nodes){
-        if (FindParent(v) == -1){
-          que.push(v);
+        if (FindParent(v, temp_dist) == -1){
+          que.Push(v);
           temp_dist.at(v) = INF;
           upd_nodes.push_back(v);
         }
       }
     
-      while (!que.empty()){
-        int v  = que.front(); que.pop();
+      while (!que.Empty()){
+        int v  = que.Pop();
         int dv = GetDistance(v);
         for (int w : fadj->at(v)){
           if ( temp_dist.at(w) != -1 || GetDistance(w) != dv + 1) continue;
         
-          if (FindParent(w) == -1){
+          if (FindParent(w, temp_dist) == -1){
             temp_dist.at(w) = INF;
-            que.push(w);
+            que.Push(w);
           } else {
             temp_dist.at(w) = GetDistance(w);
           }
@@ -294,11 +392,12 @@ namespace betweenness_centrality {
       }
     }
 
-    void ReachabilityQuerier::FixChanges(const vector<int> &upd_nodes){
+    void ReachabilityQuerier::FixChanges(const vector<int> &upd_nodes, QuerierScratch &ws){
     typedef pair<int, int> PI;
-    priority_queue<PI, vector<PI>, greater<PI> > que;
+    FlatHeap<PI> &que = ws.heap;
+    que.Clear();
 
-    auto &temp_dist = spr_index->temp_array;
+    auto &temp_dist = ws.temp_array;
     
     for (int v : upd_nodes){
       if (temp_dist.at(v) <= GetDistance(v)) continue;
@@ -309,19 +408,19 @@ namespace betweenness_centrality {
           temp_dist.at(v) = min(dw + 1, temp_dist.at(v));
         }
       }
-      que.push(make_pair(temp_dist.at(v), v));
+      que.Push(make_pair(temp_dist.at(v), v));
     }
         
-    while (!que.empty()){
-      int d = que.top().first;
-      int v = que.top().second; que.pop();
+    while (!que.Empty()){
+      int d = que.Top().first;
+      int v = que.Top().second; que.Pop();
       if (d > temp_dist.at(v)) continue;
         
       for (int w : fadj->at(v)){
         int dw = temp_dist.at(w);
         if (dw != -1 && dw > GetDistance(w) && d + 1 < dw){
           temp_dist.at(w) = temp_dist.at(v) + 1;
-          que.push(make_pair(temp_dist.at(w), w));
+          que.Push(make_pair(temp_dist.at(w), w));
         }
       }
     }
@@ -337,32 +436,35 @@ namespace betweenness_centrality {
     distance.resize(0);
   }
 
-  void ReachabilityQuerier::DeleteEdge(int u, int v){
-    bool prev_tree_reach = (bool)(source_in_mask & target_out_mask);
+  void ReachabilityQuerier::DeleteEdge(int u, int v, QuerierScratch &ws){
+    bool prev_tree_reach = source_in_mask.Intersects(target_out_mask);
     bool mask_change = TargetMaskChanged();
     UpdateMask();
     
     if (ReachByTrees()){
       distance.clear();
     } else if (mask_change || prev_tree_reach){
-      this->Build();
+      this->Build(ws);
     } else {
       if (GetDistance(u) + 1 == GetDistance(v)){
-        vector<int> upd_nodes;
-        CollectChanges({v}, upd_nodes);
-        FixChanges(upd_nodes);
-        // change_vs_ed += upd_nodes.size();
+        vector<int> &start_nodes = ws.start_nodes;
+        vector<int> &upd_nodes   = ws.upd_nodes;
+        start_nodes.assign(1, v);
         upd_nodes.clear();
+        CollectChanges(start_nodes, upd_nodes, ws);
+        FixChanges(upd_nodes, ws);
+        // change_vs_ed += upd_nodes.size();
       }
       
       typedef pair<int, int> PI;
-      priority_queue<PI, vector<PI>, greater<PI> > que;
+      FlatHeap<PI> &que = ws.heap;
+      que.Clear();
       const vector<int> *chg_nodes = spr_index->GetRCNodes();
       // change_vs_ed += chg_nodes->size();
       
       for (auto it = chg_nodes->begin(); it != chg_nodes->end(); it++){
         int v = *it;
-        if (!this->Prune(v)){
+        if (!this->Prune(v, ws.counts)){
           int best_dist = INF;
           for (int w : badj->at(v)){
             best_dist = min(best_dist, this->GetDistance(w));
@@ -370,19 +472,19 @@ namespace betweenness_centrality {
           
           if (best_dist < INF){
             distance[v] = best_dist + 1;
-            que.push(PI(distance[v], v));
+            que.Push(PI(distance[v], v));
           }
         }
       }
-      while (!que.empty()){
-        int v = que.top().second; 
-        int d = que.top().first; que.pop();
+      while (!que.Empty()){
+        int v = que.Top().second; 
+        int d = que.Top().first; que.Pop();
         if (d > distance[v]) continue;
 
         for (int w : fadj->at(v)){
-          if (!this->Prune(w) && d + 1 < this->GetDistance(w)){
+          if (!this->Prune(w, ws.counts) && d + 1 < this->GetDistance(w)){
             distance[w] = d + 1;
-            que.push(PI(distance[w], w));
+            que.Push(PI(distance[w], w));
           }
         }
       }
@@ -395,39 +497,42 @@ namespace betweenness_centrality {
     assert(0 <= u && (size_t)u < badj->size());
   }
 
-  void ReachabilityQuerier::DeleteNode(int u, const vector<int> &u_out, const vector<int> &){
+  void ReachabilityQuerier::DeleteNode(int u, const vector<int> &u_out, const vector<int> &, QuerierScratch &ws){
     assert(fadj->at(u).empty());
     assert(badj->at(u).empty());
-    bool prev_tree_reach = (bool)(source_in_mask & target_out_mask);
+    bool prev_tree_reach = source_in_mask.Intersects(target_out_mask);
     bool mask_change     = TargetMaskChanged();
     
     if (ReachByTrees()){
       distance.clear();
     } else if (mask_change || prev_tree_reach){
-      this->Build();
+      this->Build(ws);
     } else {
       if (distance.count(u) > 0){
-        vector<int> start_nodes;
-        vector<int> upd_nodes;
+        vector<int> &start_nodes = ws.start_nodes;
+        vector<int> &upd_nodes   = ws.upd_nodes;
+        start_nodes.clear();
+        upd_nodes.clear();
         int dist_u = GetDistance(u);
         for (int v : u_out){
           if (dist_u + 1 == GetDistance(v)) start_nodes.push_back(v);
         }
         distance.erase(u);
-        CollectChanges(start_nodes, upd_nodes);
-        FixChanges(upd_nodes);
+        CollectChanges(start_nodes, upd_nodes, ws);
+        FixChanges(upd_nodes, ws);
         // change_vs_vd += upd_nodes.size();
         assert(distance.count(u) == 0);
       }
       
       typedef pair<int, int> PI;
-      priority_queue<PI, vector<PI>, greater<PI> > que;
+      FlatHeap<PI> &que = ws.heap;
+      que.Clear();
       const vector<int> *chg_nodes = spr_index->GetRCNodes();
       // change_vs_vd += chg_nodes->size();
       
       for (auto it = chg_nodes->begin(); it != chg_nodes->end(); it++){
         int v = *it;
-        if (!this->Prune(v)){
+        if (!this->Prune(v, ws.counts)){
           int best_dist = INF;
           for (int w : badj->at(v)){
             best_dist = min(best_dist, this->GetDistance(w));
@@ -435,19 +540,19 @@ namespace betweenness_centrality {
           
           if (best_dist < INF){
             distance[v] = best_dist + 1;
-            que.push(PI(distance[v], v));
+            que.Push(PI(distance[v], v));
           }
         }
       }
-      while (!que.empty()){
-        int v = que.top().second; 
-        int d = que.top().first; que.pop();
+      while (!que.Empty()){
+        int v = que.Top().second; 
+        int d = que.Top().first; que.Pop();
         if (d > distance[v]) continue;
 
         for (int w : fadj->at(v)){
-          if (!this->Prune(w) && d + 1 < this->GetDistance(w)){
+          if (!this->Prune(w, ws.counts) && d + 1 < this->GetDistance(w)){
             distance[w] = d + 1;
-            que.push(PI(distance[w], w));
+            que.Push(PI(distance[w], w));
           }
         }
       }
@@ -485,8 +590,9 @@ namespace betweenness_centrality {
 
     
   
-    SpecialPurposeReachabilityIndex::SpecialPurposeReachabilityIndex(vector<vector<int> >  *fadj, vector<vector<int> >  *badj, int num_rs)
-      : fadj(fadj), badj(badj), id_manager(fadj->size()), num_rs(num_rs)
+    SpecialPurposeReachabilityIndex::SpecialPurposeReachabilityIndex(vector<vector<int> >  *fadj, vector<vector<int> >  *badj, int num_rs, ThreadPool *pool,
+                                                                     RootSelection selection)
+      : fadj(fadj), badj(badj), id_manager(fadj->size()), pool(pool), prune_counts(num_rs), adapt_interval(0), num_swaps(0), num_rs(num_rs)
     {
       CHECK(fadj != nullptr && badj != nullptr && num_rs <= num_rs_limit);
     
@@ -495,26 +601,218 @@ namespace betweenness_centrality {
       // JLOG_ADD_BENCHMARK("spr_index.construct_time"){
       // #endif
       has_change.resize(V, false);
-      temp_array.resize(V, -1);
+      reach_masks.resize(V);
+      ResizeScratch();
+
+      SelectRoots(selection);
+      // the trees are independent of each other, so all 2 * num_rs of them are built at once
       for (int i = 0; i < 2; i++){
-        reach_mask[i].resize(V, 0);
+        spts[i].assign(num_rs, nullptr);
+      }
+      ParallelFor(2 * num_rs, [&](size_t j){
+          int i = j % 2, k = j / 2;
+          spts[i][k] = i == 0 ? new DynamicSPT(roots[k], fadj, badj) : new DynamicSPT(roots[k], badj, fadj);
+        });
+      UpdateReachMasks(0, num_rs);
+      rng.Seed(rand());
+      // #ifdef NDEBUG
+      // }
+      // #endif 
+    }
+  
+    void SpecialPurposeReachabilityIndex::SelectRoots(RootSelection selection){
+      roots.clear();
+      if (selection == RANDOM_ROOTS){
+        for (int k = 0; k < num_rs; k++){
+          roots.push_back(rand() % V);
+        }
+        return;
+      }
+      
+      vector<int> degree(V), comp(V, 0), comp_size(1, V);
+      for (int v = 0; v < V; v++){
+        degree[v] = fadj->at(v).size() + badj->at(v).size();
+      }
+      if (selection == SCC_ROOTS){
+        comp_size.assign(StronglyConnectedComponents(*fadj, comp), 0);
+        for (int v = 0; v < V; v++) comp_size[comp[v]]++;
+      }
+      // vertices in larger components first, and those of higher degrees first in each component
+      vector<int> order(V);
+      iota(order.begin(), order.end(), 0);
+      sort(order.begin(), order.end(), [&](int u, int v){
+          if (comp_size[comp[u]] != comp_size[comp[v]]) return comp_size[comp[u]] > comp_size[comp[v]];
+          if (comp[u] != comp[v]) return comp[u] < comp[v];
+          if (degree[u] != degree[v]) return degree[u] > degree[v];
+          return u < v;
+        });
+      
+      // the first vertex of each component, and then the rest if there are fewer components than roots
+      vector<char> taken(V, false);
+      for (int i = 0; i < V && (int)roots.size() < num_rs; i++){
+        if (i == 0 || comp[order[i]] != comp[order[i - 1]]){
+          roots.push_back(order[i]);
+          taken[order[i]] = true;
+        }
+      }
+      for (int i = 0; i < V && (int)roots.size() < num_rs; i++){
+        if (!taken[order[i]]) roots.push_back(order[i]);
+      }
+      for (int k = V; k < num_rs; k++){
+        roots.push_back(roots[k % V]);
       }
+    }
 
-      for (int k = 0; k < num_rs; k++){
-        int root = rand() % V;
-        roots.push_back(root);
-        spts[0].push_back(new DynamicSPT(root, fadj, badj));
-        spts[1].push_back(new DynamicSPT(root, badj, fadj));
+    void SpecialPurposeReachabilityIndex::ChangeRoot(int k, int root){
+      roots[k] = root;
+      spts[0][k]->ChangeRoot(root);
+      spts[1][k]->ChangeRoot(root);
+      UpdateReachMasks(k, k + 1);
+    }
 
-        for (int v = 0; v < V; v++){
+    void SpecialPurposeReachabilityIndex::AdaptRoots(){
+      if (adapt_interval == 0 || num_rs == 0 || prune_counts.tests < adapt_interval) return;
+      const vector<uint64_t> &hits = prune_counts.hits;
+      int worst = min_element(hits.begin(), hits.end()) - hits.begin();
+      uint64_t total = accumulate(hits.begin(), hits.end(), uint64_t(0));
+      bool useless = hits[worst] * num_rs * 4 <= total;
+      prune_counts.Clear();
+      if (!useless) return;
+      
+      // a vertex in the same component as another root would give the same tree
+      const int num_candidates = 16;
+      int best = -1;
+      for (int i = 0; i < num_candidates && id_manager.NumAlive() > 0; i++){
+        int v = id_manager.SampleAlive(rng);
+        ReachMask same_comp = GetOutMask(v) & GetInMask(v);
+        same_comp.Set(worst, false);
+        bool redundant = find(roots.begin(), roots.end(), v) != roots.end() || same_comp.Any();
+        if (!redundant && (best == -1 || fadj->at(v).size() + badj->at(v).size() > fadj->at(best).size() + badj->at(best).size())){
+          best = v;
+        }
+      }
+      if (best == -1) return;
+      
+      ChangeRoot(worst, best);
+      num_swaps++;
+      // the masks of many vertices may have changed, so the queriers search again
+      ForEachQuerier([](ReachabilityQuerier *prq, QuerierScratch &ws){ prq->Build(ws); });
+    }
+
+    // Sets bits [k_begin, k_end) of the masks of all vertices from the trees, in one pass over
+    // blocks of vertices: the masks of a block stay in the cache while the
+    // distances of every tree are streamed over it, and each inner loop is
+    // a plain loop over consecutive vertices that the compiler can vectorize.
+    void SpecialPurposeReachabilityIndex::UpdateReachMasks(int k_begin, int k_end){
+      const int block_size = 4096;
+      auto update = [&](size_t b){
+        int begin = b * block_size;
+        int end   = min(V, begin + block_size);
+        for (int k = k_begin; k < k_end; k++){
           for (int i = 0; i < 2; i++){
-            SetBit(reach_mask[i][v], k, spts[i].back()->GetDistance(v) < INF);
+            const int *dist = spts[i][k]->GetTreeNodes()->data();
+            VertexMasks *masks = reach_masks.data();
+            uint64_t bit = uint64_t(1) << (k & 63);
+            for (int v = begin; v < end; v++){
+              uint64_t &word = masks[v].mask[i].words[k >> 6];
+              word = (word & ~bit) | (dist[v] < INF ? bit : 0);
+            }
           }
         }
+      };
+      ParallelFor((V + block_size - 1) / block_size, update);
+    }
+
+    void SpecialPurposeReachabilityIndex::ParallelFor(size_t n, const function<void(size_t)> &f){
+      if (pool != nullptr && n > 1){
+        pool->ParallelFor(n, [&](int, size_t i){ f(i); });
+      } else {
+        for (size_t i = 0; i < n; i++) f(i);
       }
-      // #ifdef NDEBUG
-      // }
-      // #endif 
+    }
+
+    void SpecialPurposeReachabilityIndex::ForEachQuerier(const function<void(ReachabilityQuerier*, QuerierScratch&)> &f){
+      if (pool != nullptr && pr_queriers.size() > 1){
+        pool->ParallelFor(pr_queriers.size(), [&](int worker, size_t i){ f(pr_queriers[i], scratch[worker]); });
+      } else {
+        for (auto prq : pr_queriers) f(prq, scratch[0]);
+      }
+      for (auto &ws : scratch){
+        prune_counts.Add(ws.counts);
+        ws.counts.Clear();
+      }
+    }
+
+    void SpecialPurposeReachabilityIndex::SetThreadPool(ThreadPool *pool){
+      this->pool = pool;
+      ResizeScratch();
+    }
+
+    void SpecialPurposeReachabilityIndex::ResizeScratch(){
+      scratch.resize(pool != nullptr ? pool->NumThreads() : 1);
+      for (auto &ws : scratch){
+        ws.temp_array.resize(V, -1);
+        if (ws.counts.hits.size() != (size_t)num_rs) ws.counts = PruneCounts(num_rs);
+      }
+    }
+
+    SpecialPurposeReachabilityIndex::SpecialPurposeReachabilityIndex(vector<vector<int> >  *fadj, vector<vector<int> >  *badj, SnapshotReader &in,
+                                                                     ThreadPool *pool)
+      : fadj(fadj), badj(badj), id_manager(0), pool(pool), adapt_interval(0), num_swaps(0), num_rs(0), V(0)
+    {
+      CHECK(fadj != nullptr && badj != nullptr);
+      int mask_bits = in.Get<int>();
+      num_rs        = in.Get<int>();
+      V             = in.Get<int>();
+      if (mask_bits != ReachMask::kNumBits || num_rs < 0 || num_rs > num_rs_limit){
+        // written by a build with another SPR_MASK_WORDS
+        in.SetFailed();
+        num_rs = V = 0;
+        ResizeScratch();
+        return;
+      }
+      CHECK(in.Failed() || (size_t)V == fadj->size());
+      
+      in.GetVector(roots);
+      in.GetVector(reach_masks);
+      id_manager.Load(in);
+      rng.SetState(in.Get<uint64_t>());
+      in.GetVector(prune_counts.hits);
+      prune_counts.hits.resize(num_rs, 0);
+      prune_counts.tests = in.Get<uint64_t>();
+      num_swaps          = in.Get<uint64_t>();
+      for (int k = 0; k < num_rs; k++){
+        spts[0].push_back(new DynamicSPT(in, fadj, badj));
+        spts[1].push_back(new DynamicSPT(in, badj, fadj));
+      }
+      
+      size_t num_queriers = in.Get<uint64_t>();
+      for (size_t i = 0; i < num_queriers && !in.Failed(); i++){
+        pr_queriers.push_back(new ReachabilityQuerier(in, fadj, badj, this));
+        pr_queriers.back()->pos = i;
+      }
+      has_change.resize(V, false);
+      ResizeScratch();
+    }
+
+    void SpecialPurposeReachabilityIndex::Save(SnapshotWriter &out) const {
+      out.Put<int>(ReachMask::kNumBits);
+      out.Put(num_rs);
+      out.Put(V);
+      out.PutVector(roots);
+      out.PutVector(reach_masks);
+      id_manager.Save(out);
+      out.Put(rng.GetState());
+      out.PutVector(prune_counts.hits);
+      out.Put(prune_counts.tests);
+      out.Put(num_swaps);
+      for (int k = 0; k < num_rs; k++){
+        spts[0][k]->Save(out);
+        spts[1][k]->Save(out);
+      }
+      
+      out.Put<uint64_t>(pr_queriers.size());
+      for (auto prq : pr_queriers) prq->Save(out);
     }
   
     SpecialPurposeReachabilityIndex::~SpecialPurposeReachabilityIndex(){
@@ -529,28 +827,24 @@ namespace betweenness_centrality {
   
     void SpecialPurposeReachabilityIndex::InsertEdge(int u, int v){
       chg_nodes.clear();
-
-      for (int k = 0; k < num_rs; k++){
-        spts[0][k]->InsertEdge(u, v);
-        spts[1][k]->InsertEdge(v, u);
-      }
+      ParallelFor(2 * num_rs, [&](size_t j){
+          if (j % 2 == 0) spts[0][j / 2]->InsertEdge(u, v);
+          else            spts[1][j / 2]->InsertEdge(v, u);
+        });
       CollectRCNodes();
-      for (auto prq : pr_queriers){
-        prq->InsertEdge(u, v);
-      }
+      ForEachQuerier([&](ReachabilityQuerier *prq, QuerierScratch &ws){ prq->InsertEdge(u, v, ws); });
+      AdaptRoots();
     }
   
     void SpecialPurposeReachabilityIndex::DeleteEdge(int u, int v){
       chg_nodes.clear();
-      for (int k = 0; k < num_rs; k++){
-        spts[0][k]->DeleteEdge(u, v);
-        spts[1][k]->DeleteEdge(v, u);
-      }
+      ParallelFor(2 * num_rs, [&](size_t j){
+          if (j % 2 == 0) spts[0][j / 2]->DeleteEdge(u, v);
+          else            spts[1][j / 2]->DeleteEdge(v, u);
+        });
       CollectRCNodes();
-
-      for (auto prq : pr_queriers){
-        prq->DeleteEdge(u, v);
-      }
+      ForEachQuerier([&](ReachabilityQuerier *prq, QuerierScratch &ws){ prq->DeleteEdge(u, v, ws); });
+      AdaptRoots();
     }
     
     void SpecialPurposeReachabilityIndex::InsertNode(int u){
@@ -560,12 +854,9 @@ namespace betweenness_centrality {
       if (new_V > V){
         for (; V < new_V; V++){
           has_change.push_back(false);
-          temp_array.push_back(-1);
-
-          for (int i = 0; i < 2; i++){
-            reach_mask[i].push_back(0);
-          }
+          reach_masks.push_back(VertexMasks());
         }
+        ResizeScratch();
         chg_nodes.clear();
         for (int k = 0; k < num_rs; k++){
           for (int i = 0; i < 2; i++){
@@ -580,43 +871,63 @@ namespace betweenness_centrality {
         CHECK(prq != nullptr);
         prq->InsertNode(u);
       }
+      AdaptRoots();
     }
   
     void SpecialPurposeReachabilityIndex::DeleteNode(int u, const vector<int> &u_out, const vector<int> &u_in){
       CHECK(fadj->at(u).empty() && badj->at(u).empty());
       chg_nodes.clear();
       id_manager.MakeDead(u);
+      // new roots are drawn in order, so that the random generator is used as without threads
+      vector<int> new_roots(roots);
       for (int k = 0; k < num_rs; k++){
-        if (roots[k] == u){
-          while (roots[k] == u && id_manager.NumAlive()) {
-            roots[k] = id_manager.SampleAlive();
-          }
-          spts[0][k]->ChangeRoot(roots[k]);
-          spts[1][k]->ChangeRoot(roots[k]);
-
-          for (int v = 0; v < V; v++){
-            for (int i = 0; i < 2; i++){
-              SetBit(reach_mask[i][v], k, spts[i][k]->GetDistance(v) < INF);
-            }
+        while (new_roots[k] == u && id_manager.NumAlive()) {
+          new_roots[k] = id_manager.SampleAlive(rng);
+        }
+      }
+      ParallelFor(2 * num_rs, [&](size_t j){
+          int i = j % 2, k = j / 2;
+          if (roots[k] != u){
+            spts[i][k]->DeleteNode(u, i == 0 ? u_out : u_in, i == 0 ? u_in : u_out);
+          } else {
+            spts[i][k]->ChangeRoot(new_roots[k]);
           }
-        } else {
-          spts[0][k]->DeleteNode(u, u_out, u_in);
-          spts[1][k]->DeleteNode(u, u_in, u_out);
+        });
+      for (int k = 0; k < num_rs; k++){
+        if (roots[k] == u){
+          roots[k] = new_roots[k];
+          UpdateReachMasks(k, k + 1);
         }
       }
       CollectRCNodes();
-
-      for (auto prq : pr_queriers){
-        CHECK(prq != nullptr);
-        prq->DeleteNode(u, u_out, u_in);
-      }
+      ForEachQuerier([&](ReachabilityQuerier *prq, QuerierScratch &ws){ prq->DeleteNode(u, u_out, u_in, ws); });
+      AdaptRoots();
     }
 
     ReachabilityQuerier *SpecialPurposeReachabilityIndex::CreateQuerier(int source, int target){
-      ReachabilityQuerier *prq = new ReachabilityQuerier(source, target, fadj, badj, this);
+      return CreateQuerier(source, target, scratch[0].que);
+    }
+
+    ReachabilityQuerier *SpecialPurposeReachabilityIndex::CreateQuerier(int source, int target, FlatQueue<int> &que){
+      PruneCounts counts(num_rs);
+      ReachabilityQuerier *prq = new ReachabilityQuerier(source, target, fadj, badj, this, que, counts);
+      lock_guard<mutex> lock(pr_queriers_mtx);
+      prq->pos = pr_queriers.size();
       pr_queriers.push_back(prq);
+      prune_counts.Add(counts);
       return prq;
     }
+
+    void SpecialPurposeReachabilityIndex::RemoveQuerier(ReachabilityQuerier *prq){
+      {
+        lock_guard<mutex> lock(pr_queriers_mtx);
+        CHECK(prq->pos < pr_queriers.size() && pr_queriers[prq->pos] == prq);
+        pr_queriers[prq->pos] = pr_queriers.back();
+        pr_queriers[prq->pos]->pos = prq->pos;
+        pr_queriers.pop_back();
+      }
+      delete prq;
+    }
   
     const vector<pair<int, vector<int> > > SpecialPurposeReachabilityIndex::GetTrees() const {
       vector<pair<int, vector<int> > >  res;
@@ -636,13 +947,13 @@ namespace betweenness_centrality {
           const vector<int> *upd_nodes = spts[i][k]->GetDCNodes();
           for (auto it = upd_nodes->begin(); it != upd_nodes->end(); it++){
             int  v         = *it;
-            bool cur_reach = GetBit(reach_mask[i][v], k);
+            bool cur_reach = reach_masks[v].mask[i].Test(k);
             bool nxt_reach = spts[i][k]->GetDistance(v) < INF;
             if (cur_reach != nxt_reach && !has_change[v]) {
               chg_nodes.push_back(v);
               has_change[v] = true;
             }
-            SetBit(reach_mask[i][v], k, nxt_reach);
+            reach_masks[v].mask[i].Set(k, nxt_reach);
           }
         }
       }
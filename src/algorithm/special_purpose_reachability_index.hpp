@@ -7,10 +7,24 @@
 #include <limits>
 #include <numeric>
 #include <iostream>
+#include <mutex>
+#include <functional>
 #include "sparsehash/dense_hash_map"
 #include "id_manager.hpp"
+#include "traversal.hpp"
+#include "snapshot.hpp"
+#include "thread_pool.hpp"
+#include "bit_mask.hpp"
 using std::vector;
 
+// Number of 64-bit words in a reach mask, which bounds the number of roots
+// of the reachability index by 64 * SPR_MASK_WORDS. Set it at compile time
+// (-DSPR_MASK_WORDS=4 for up to 256 roots); snapshots are only read back by
+// a build with the same value.
+#ifndef SPR_MASK_WORDS
+#define SPR_MASK_WORDS 1
+#endif
+
 namespace betweenness_centrality {
   
   namespace special_purpose_reachability_index {
@@ -19,43 +33,129 @@ namespace betweenness_centrality {
     template <typename T, typename E> using hash_map = google::dense_hash_map<T,E>;
     constexpr static int INF = std::numeric_limits<int>::max() / 2;
     
+    // Bit k is set if the tree of the k-th root contains the vertex.
+    typedef BitMask<SPR_MASK_WORDS> ReachMask;
+    // The masks of a vertex in the trees from the roots (out, [0]) and to
+    // the roots (in, [1]), side by side and aligned, so that both of them
+    // lie in one cache line for up to 256 roots.
+    struct alignas(2 * sizeof(ReachMask) < 64 ? 2 * sizeof(ReachMask) : 64) VertexMasks {
+      ReachMask mask[2];
+    };
+
+    // How the roots of the trees are chosen. Roots in large strongly connected
+    // components reach (and are reached by) many vertices, so their trees let
+    // the queriers prune more than those of random roots.
+    enum RootSelection {
+      RANDOM_ROOTS,     // uniformly at random
+      DEGREE_ROOTS,     // the vertices of the highest total degree
+      SCC_ROOTS,        // one vertex of the highest degree in each of the largest components
+    };
+
+    // Number of vertices that the queriers tested against the trees while
+    // searching, and how many of them each root pruned.
+    struct PruneCounts {
+      vector<uint64_t> hits;
+      uint64_t         tests;
+      explicit PruneCounts(int num_rs = 0) : hits(num_rs, 0), tests(0) {}
+      void Add(const PruneCounts &other);
+      void Clear();
+    };
+
+    // Scratch of the queriers for updates. Each thread that updates queriers
+    // has its own, so that the queriers can be updated in parallel.
+    struct QuerierScratch {
+      vector<int> temp_array;  // -1 for every vertex between updates
+      FlatQueue<int> que;
+      FlatQueue<std::pair<int, int> > pair_que;
+      FlatHeap<std::pair<int, int> >  heap;
+      vector<int> start_nodes;
+      vector<int> upd_nodes;
+      PruneCounts counts;
+    };
+    
     class SpecialPurposeReachabilityIndex {
     private:
       friend class ReachabilityQuerier;
       
       vector<int> roots;
-      vector<int> reach_mask[2];
+      vector<VertexMasks, AlignedAllocator<VertexMasks> > reach_masks;
       vector<DynamicSPT*> spts[2];
       vector<vector<int> >  *fadj;
       vector<vector<int> >  *badj;
       IDManager id_manager;
+      Random    rng;  // picks a new root when a root is deleted
     
-      vector<int> temp_array;
       vector<int> has_change;
       vector<int> chg_nodes;
+      // the trees and then the queriers are updated on the threads of pool, if any,
+      // and scratch[i] is that of the i-th thread
+      ThreadPool            *pool;
+      vector<QuerierScratch> scratch;
       vector<ReachabilityQuerier*> pr_queriers;
+      std::mutex                   pr_queriers_mtx;
+      // statistics since the last adaptation of the roots (see SetAdaptInterval)
+      PruneCounts prune_counts;
+      uint64_t    adapt_interval;
+      uint64_t    num_swaps;
       int num_rs;
       int V;
-      static const int num_rs_limit = 30;
+      static const int num_rs_limit = ReachMask::kNumBits;
     
     public:
     
-      SpecialPurposeReachabilityIndex(vector<vector<int> >  *fadj, vector<vector<int> >  *badj, int num_rs);
+      // Builds the trees of the num_rs roots on the threads of pool, if any.
+      // Updates use the same pool, which must outlive the index or be replaced by SetThreadPool.
+      SpecialPurposeReachabilityIndex(vector<vector<int> >  *fadj, vector<vector<int> >  *badj, int num_rs, ThreadPool *pool = nullptr,
+                                      RootSelection selection = RANDOM_ROOTS);
+      // Restores an index written by Save, including its queriers, on the same graph.
+      SpecialPurposeReachabilityIndex(vector<vector<int> >  *fadj, vector<vector<int> >  *badj, SnapshotReader &in,
+                                      ThreadPool *pool = nullptr);
+      void Save(SnapshotWriter &out) const;
       virtual ~SpecialPurposeReachabilityIndex();
       void InsertEdge(int u, int v);
       void DeleteEdge(int u, int v);
       void InsertNode(int u);
       void DeleteNode(int u, const vector<int> &u_out, const vector<int> &u_in);
+      // The index owns its queriers and updates every one of them, so a querier
+      // that is no longer needed has to be given back with RemoveQuerier.
       ReachabilityQuerier *CreateQuerier(int source, int target); 
+      // Same as above, but searches with the given queue instead of the scratch of the index,
+      // so that several threads can create queriers at once as long as the index is not updated.
+      ReachabilityQuerier *CreateQuerier(int source, int target, FlatQueue<int> &que);
+      // Unregisters and deletes prq. Like CreateQuerier, it may be called from several threads.
+      void RemoveQuerier(ReachabilityQuerier *prq);
+      void SetThreadPool(ThreadPool *pool);
       const vector<int> GetRoots() const { return roots; }
+      const vector<ReachabilityQuerier*> &GetQueriers() const { return pr_queriers; }
+      Random &GetRandom() { return rng; }
+      
+      // Adaptive roots: once the queriers have tested interval vertices in
+      // their searches, the root that pruned the fewest of them is replaced
+      // if it pruned less than a quarter of the average, and the counts start
+      // over. The new root is the vertex of the highest degree among a few
+      // sampled ones that is not in the component of another root. 0 (the
+      // default) keeps the roots, except for deleted ones. The interval is not
+      // saved in a snapshot; the counts are.
+      void SetAdaptInterval(uint64_t interval) { adapt_interval = interval; }
+      const PruneCounts &GetPruneCounts() const { return prune_counts; }
+      uint64_t GetNumSwaps() const { return num_swaps; }
       const vector<std::pair<int, vector<int> > > GetTrees() const;
     
     private: 
-      inline int GetOutMask(int v) const { assert(ValidNode(v)); return reach_mask[0][v]; }
-      inline int GetInMask(int v) const { assert(ValidNode(v)); return reach_mask[1][v]; }
+      inline const ReachMask &GetOutMask(int v) const { assert(ValidNode(v)); return reach_masks[v].mask[0]; }
+      inline const ReachMask &GetInMask(int v) const { assert(ValidNode(v)); return reach_masks[v].mask[1]; }
       inline bool ValidNode(int v) const { return 0 <= v && v < V; }
       const vector<int> *GetRCNodes() const { return &chg_nodes; }
       void CollectRCNodes();
+      void UpdateReachMasks(int k_begin, int k_end);
+      void SelectRoots(RootSelection selection);
+      void AdaptRoots();
+      void ChangeRoot(int k, int root);
+      void ResizeScratch();
+      // Calls f(i) for every i in [0, n) on the pool, if any.
+      void ParallelFor(size_t n, const std::function<void(size_t)> &f);
+      // Calls f on every querier with the scratch of the thread, on the pool if any.
+      void ForEachQuerier(const std::function<void(ReachabilityQuerier*, QuerierScratch&)> &f);
     };
 
 
@@ -67,8 +167,14 @@ namespace betweenness_centrality {
       vector<vector<int> >  *fadj;
       vector<vector<int> >  *badj;
       vector<int> chg_nodes;
+      FlatQueue<int> que;
+      FlatHeap<std::pair<int, int> > heap;
+      vector<int> start_nodes;
+      vector<int> upd_nodes;
     public:
       DynamicSPT(int r, vector<vector<int> >  *fadj, vector<vector<int> >  *badj);
+      DynamicSPT(SnapshotReader &in, vector<vector<int> >  *fadj, vector<vector<int> >  *badj);
+      void Save(SnapshotWriter &out) const;
       inline int  GetRoot() const { return root; }
       inline int  GetDistance(int v) { assert(ValidNode(v)); return curr_dist[v]; }
     
@@ -90,10 +196,11 @@ namespace betweenness_centrality {
 
     class ReachabilityQuerier {
       friend class SpecialPurposeReachabilityIndex;
+      size_t pos;  // in spr_index->pr_queriers
       int source;
       int target;
-      int source_in_mask, source_out_mask;
-      int target_in_mask, target_out_mask;
+      ReachMask source_in_mask, source_out_mask;
+      ReachMask target_in_mask, target_out_mask;
       hash_map<int, int>  distance;
       vector<vector<int> > *fadj;
       vector<vector<int> > *badj;
@@ -102,39 +209,50 @@ namespace betweenness_centrality {
     public: 
       ReachabilityQuerier(int source,
                           int tagret,
+                          vector<vector<int> > *fadj,
+                          vector<vector<int> > *badj,
+                          SpecialPurposeReachabilityIndex *spr_index,
+                          FlatQueue<int> &que,
+                          PruneCounts &counts);
+      ReachabilityQuerier(SnapshotReader &in,
                           vector<vector<int> > *fadj,
                           vector<vector<int> > *badj,
                           SpecialPurposeReachabilityIndex *spr_index);
+      void Save(SnapshotWriter &out) const;
       bool Reach() const;
       inline int GetSource() const { return source; }
       inline int GetTarget() const { return target; }
       const vector<int> GetIndexNodes() const;
     private:
-      void Build();
-      void InsertEdge(int u, int v);
-      void DeleteEdge(int u, int v);
+      void Build(QuerierScratch &ws);
+      void Build(FlatQueue<int> &que, PruneCounts &counts);
+      void InsertEdge(int u, int v, QuerierScratch &ws);
+      void DeleteEdge(int u, int v, QuerierScratch &ws);
       void InsertNode(int u);
-      void DeleteNode(int u, const vector<int> &u_out, const vector<int> &u_in);
+      void DeleteNode(int u, const vector<int> &u_out, const vector<int> &u_in, QuerierScratch &ws);
       bool TargetMaskChanged() const ;
       bool SourceMaskChanged() const ;
       void UpdateMask();
     
       inline bool ReachByTrees() const {
-        return spr_index->GetOutMask(target) & spr_index->GetInMask(source);
+        return spr_index->GetOutMask(target).Intersects(spr_index->GetInMask(source));
       }
       
+      // Whether a root reaches v but not target, in which case v cannot reach target.
       inline bool Prune(int v) const {
-        return ~spr_index->GetOutMask(target) & spr_index->GetOutMask(v);
+        return spr_index->GetOutMask(v).AnyNotIn(spr_index->GetOutMask(target));
       }
+      // Same as above, and counts the test and the roots that pruned v.
+      bool Prune(int v, PruneCounts &counts) const;
       
       inline int GetDistance(int v) const {
         auto iter = distance.find(v);
         return iter == distance.end() ? INF : iter->second;
       }
 
-      int FindParent(int v) const ;
-      void CollectChanges(const vector<int> &start_nodes, vector<int> &upd_nodes);
-      void FixChanges(const vector<int> &upd_nodes);
+      int FindParent(int v, const vector<int> &temp_dist) const ;
+      void CollectChanges(const vector<int> &start_nodes, vector<int> &upd_nodes, QuerierScratch &ws);
+      void FixChanges(const vector<int> &upd_nodes, QuerierScratch &ws);
     };
 
   } /* special_purpose_reachability_index */
@@ -0,0 +1,109 @@
+#include "thread_pool.hpp"
+#include "common.hpp"
+using namespace std;
+
+namespace betweenness_centrality {
+
+  ThreadPool::ThreadPool(int num_threads)
+    : num_threads(num_threads), ranges(nullptr), task(nullptr), generation(0), num_running(0), shutdown(false)
+  {
+    CHECK(num_threads >= 1);
+    ranges = new Range[num_threads];
+    for (int i = 1; i < num_threads; i++){
+      workers.emplace_back(&ThreadPool::WorkerLoop, this, i);
+    }
+  }
+
+  ThreadPool::~ThreadPool(){
+    {
+      lock_guard<mutex> lock(mtx);
+      shutdown = true;
+    }
+    start_cv.notify_all();
+    for (auto &th : workers) th.join();
+    SafeDeleteArray(ranges);
+  }
+
+  void ThreadPool::ParallelFor(size_t n, const function<void(int, size_t)> &f){
+    if (num_threads == 1 || n <= 1){
+      for (size_t i = 0; i < n; i++) f(0, i);
+      return;
+    }
+
+    for (int i = 0; i < num_threads; i++){
+      ranges[i].begin = n *  i      / num_threads;
+      ranges[i].end   = n * (i + 1) / num_threads;
+    }
+    {
+      lock_guard<mutex> lock(mtx);
+      task = &f;
+      num_running = num_threads - 1;
+      generation++;
+    }
+    start_cv.notify_all();
+
+    Run(0);
+
+    unique_lock<mutex> lock(mtx);
+    finish_cv.wait(lock, [this]{ return num_running == 0; });
+    task = nullptr;
+  }
+
+  void ThreadPool::WorkerLoop(int id){
+    size_t seen = 0;
+    for (;;){
+      {
+        unique_lock<mutex> lock(mtx);
+        start_cv.wait(lock, [&]{ return shutdown || generation != seen; });
+        if (shutdown) return;
+        seen = generation;
+      }
+
+      Run(id);
+
+      lock_guard<mutex> lock(mtx);
+      if (--num_running == 0) finish_cv.notify_one();
+    }
+  }
+
+  void ThreadPool::Run(int id){
+    Range &own = ranges[id];
+    for (;;){
+      size_t i = 0;
+      bool   found = false;
+      {
+        lock_guard<mutex> lock(own.mtx);
+        if (own.begin < own.end){
+          i = own.begin++;
+          found = true;
+        }
+      }
+      if (found){
+        (*task)(id, i);
+      } else if (!Steal(id)){
+        return;
+      }
+    }
+  }
+
+  bool ThreadPool::Steal(int id){
+    // Only the owner ever refills its own range, and it does so only when the
+    // range is empty, so we never need to hold two locks at once.
+    for (int k = 1; k < num_threads; k++){
+      Range &victim = ranges[(id + k) % num_threads];
+      size_t begin, end;
+      {
+        lock_guard<mutex> lock(victim.mtx);
+        if (victim.begin >= victim.end) continue;
+        end   = victim.end;
+        begin = end - (end - victim.begin + 1) / 2;
+        victim.end = begin;
+      }
+      lock_guard<mutex> lock(ranges[id].mtx);
+      ranges[id].begin = begin;
+      ranges[id].end   = end;
+      return true;
+    }
+    return false;
+  }
+}
@@ -0,0 +1,57 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <cstdlib>
+
+namespace betweenness_centrality {
+
+  // A fixed set of worker threads that runs index loops with work stealing.
+  // Every worker starts from its own contiguous chunk of [0, n) and, once it
+  // runs dry, steals the latter half of another worker's remaining chunk, so
+  // that a few expensive iterations do not stall the whole loop.
+  // The calling thread takes part as worker 0; ThreadPool(1) spawns nothing.
+  class ThreadPool {
+  private:
+    struct Range {
+      std::mutex mtx;
+      size_t     begin;
+      size_t     end;
+      char       padding[64];  // keep ranges of different workers off one cache line
+    };
+
+    int num_threads;
+    std::vector<std::thread> workers;
+    Range *ranges;
+
+    std::mutex              mtx;
+    std::condition_variable start_cv;
+    std::condition_variable finish_cv;
+    const std::function<void(int, size_t)> *task;
+    size_t generation;
+    int    num_running;
+    bool   shutdown;
+
+    void WorkerLoop(int id);
+    void Run(int id);
+    bool Steal(int id);
+
+  public:
+    explicit ThreadPool(int num_threads);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    inline int NumThreads() const { return num_threads; }
+
+    // Calls f(worker_id, i) for every i in [0, n) and returns when all calls finished.
+    // worker_id is in [0, NumThreads()) and no two concurrent calls share it.
+    void ParallelFor(size_t n, const std::function<void(int, size_t)> &f);
+  };
+}
+
+#endif /* THREAD_POOL_H */
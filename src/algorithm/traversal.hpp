@@ -0,0 +1,81 @@
+#ifndef TRAVERSAL_H
+#define TRAVERSAL_H
+
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <stdint.h>
+using std::vector;
+
+namespace betweenness_centrality {
+
+  // Building blocks for the many small searches run per update. They are meant
+  // to live in a per-thread workspace and be reused, so that a search costs no
+  // allocation once the buffers have grown to their working size.
+
+  // FIFO queue on a flat vector. Popped elements are not reclaimed until Clear,
+  // so Pushed() still lists everything pushed since then, in order.
+  template <typename T>
+  class FlatQueue {
+  private:
+    vector<T> data;
+    size_t    head;
+
+  public:
+    FlatQueue() : head(0) {}
+    inline void Clear(){ data.clear(); head = 0; }
+    inline bool Empty() const { return head == data.size(); }
+    inline void Push(const T &x){ data.push_back(x); }
+    inline const T &Front() const { return data[head]; }
+    inline T Pop(){ return data[head++]; }
+    inline const vector<T> &Pushed() const { return data; }
+  };
+
+  // Binary min-heap on a flat vector; pops in the same order as
+  // std::priority_queue<T, vector<T>, std::greater<T> >.
+  template <typename T>
+  class FlatHeap {
+  private:
+    vector<T> data;
+
+  public:
+    inline void Clear(){ data.clear(); }
+    inline bool Empty() const { return data.empty(); }
+    inline const T &Top() const { return data.front(); }
+    inline void Push(const T &x){
+      data.push_back(x);
+      std::push_heap(data.begin(), data.end(), std::greater<T>());
+    }
+    inline void Pop(){
+      std::pop_heap(data.begin(), data.end(), std::greater<T>());
+      data.pop_back();
+    }
+  };
+
+  // Set of vertices cleared in O(1) by moving to a new epoch:
+  // a vertex is in the set iff its stamp equals the current epoch.
+  class EpochVisited {
+  private:
+    vector<uint32_t> stamp;
+    uint32_t         epoch;
+
+  public:
+    EpochVisited() : epoch(1) {}
+    inline void Resize(size_t n){ stamp.resize(n, 0); }
+    inline void Clear(){
+      if (++epoch == 0){
+        std::fill(stamp.begin(), stamp.end(), 0);
+        epoch = 1;
+      }
+    }
+    inline bool IsVisited(int v) const { return stamp[v] == epoch; }
+    // Returns true if v was not in the set.
+    inline bool Visit(int v){
+      if (stamp[v] == epoch) return false;
+      stamp[v] = epoch;
+      return true;
+    }
+  };
+}
+
+#endif /* TRAVERSAL_H */
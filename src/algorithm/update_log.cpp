@@ -0,0 +1,151 @@
+#include "update_log.hpp"
+#include "snapshot.hpp"
+#include "common.hpp"
+#include <cstring>
+#include <unistd.h>
+using namespace std;
+
+namespace betweenness_centrality {
+
+  namespace {
+    const char     kMagic[8] = {'H', 'A', 'Y', 'U', 'L', 'O', 'G', '\0'};
+    const uint32_t kVersion  = 1;
+
+    struct Header {
+      char     magic[8];
+      uint32_t version;
+      uint32_t reserved;
+    };
+
+    // Each record is a RecordHeader followed by its body:
+    // seq, rng_state[2], batch (uint32), the number of updates (uint32),
+    // and (type, u, v) as int32 for each update.
+    struct RecordHeader {
+      uint32_t body_size;
+      uint32_t reserved;
+      uint64_t checksum;
+    };
+
+    template <typename T> void PutValue(vector<char> &buf, const T &x){
+      const char *p = reinterpret_cast<const char*>(&x);
+      buf.insert(buf.end(), p, p + sizeof(T));
+    }
+
+    template <typename T> T GetValue(const char *&p){
+      T x;
+      memcpy(&x, p, sizeof(T));
+      p += sizeof(T);
+      return x;
+    }
+  }
+
+  UpdateLogWriter::UpdateLogWriter(const string &path, uint64_t valid_size, bool sync)
+    : fp(nullptr), sync(sync), failed(true)
+  {
+    if (valid_size == 0){
+      fp = fopen(path.c_str(), "wb");
+      if (fp == nullptr) return;
+      Header header = Header();
+      memcpy(header.magic, kMagic, sizeof(kMagic));
+      header.version = kVersion;
+      failed = fwrite(&header, sizeof(header), 1, fp) != 1 || fflush(fp) != 0;
+    } else {
+      fp = fopen(path.c_str(), "r+b");
+      if (fp == nullptr) return;
+      failed = ftruncate(fileno(fp), valid_size) != 0 || fseek(fp, 0, SEEK_END) != 0;
+    }
+  }
+
+  UpdateLogWriter::~UpdateLogWriter(){
+    if (fp != nullptr) fclose(fp);
+  }
+
+  bool UpdateLogWriter::Append(const UpdateLogRecord &rec){
+    if (failed) return false;
+    buffer.assign(sizeof(RecordHeader), 0);
+    PutValue(buffer, rec.seq);
+    PutValue(buffer, rec.rng_state[0]);
+    PutValue(buffer, rec.rng_state[1]);
+    PutValue<uint32_t>(buffer, rec.batch);
+    PutValue<uint32_t>(buffer, rec.updates.size());
+    for (const auto &upd : rec.updates){
+      PutValue<int32_t>(buffer, upd.type);
+      PutValue<int32_t>(buffer, upd.u);
+      PutValue<int32_t>(buffer, upd.v);
+    }
+
+    RecordHeader header = RecordHeader();
+    header.body_size = buffer.size() - sizeof(RecordHeader);
+    header.checksum  = Checksum(buffer.data() + sizeof(RecordHeader), header.body_size);
+    memcpy(buffer.data(), &header, sizeof(header));
+
+    failed = fwrite(buffer.data(), 1, buffer.size(), fp) != buffer.size() || fflush(fp) != 0 ||
+      (sync && fsync(fileno(fp)) != 0);
+    return !failed;
+  }
+
+  bool UpdateLogWriter::Truncate(){
+    if (failed) return false;
+    failed = fflush(fp) != 0 || ftruncate(fileno(fp), sizeof(Header)) != 0 ||
+      fseek(fp, 0, SEEK_END) != 0 || (sync && fsync(fileno(fp)) != 0);
+    return !failed;
+  }
+
+  UpdateLogReader::UpdateLogReader(const string &path) : pos(0), failed(false) {
+    FILE *fp = fopen(path.c_str(), "rb");
+    if (fp == nullptr) return;
+
+    char buf[1 << 16];
+    for (size_t n; (n = fread(buf, 1, sizeof(buf), fp)) > 0; ){
+      data.insert(data.end(), buf, buf + n);
+    }
+    fclose(fp);
+
+    Header header;
+    if (data.size() < sizeof(header)){
+      // the process died while creating the log
+      data.clear();
+      return;
+    }
+    memcpy(&header, data.data(), sizeof(header));
+    if (memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kVersion){
+      failed = true;
+      data.clear();
+      return;
+    }
+    pos = sizeof(header);
+  }
+
+  bool UpdateLogReader::Next(UpdateLogRecord &rec){
+    const size_t fixed_size = 3 * sizeof(uint64_t) + 2 * sizeof(uint32_t);
+    const size_t update_size = 3 * sizeof(int32_t);
+
+    RecordHeader header;
+    if (failed || data.size() - pos < sizeof(header)) return false;
+    memcpy(&header, data.data() + pos, sizeof(header));
+    size_t begin = pos + sizeof(header);
+    if (header.body_size < fixed_size || data.size() - begin < header.body_size ||
+        Checksum(data.data() + begin, header.body_size) != header.checksum){
+      return false;
+    }
+
+    const char *p = data.data() + begin;
+    uint32_t n;
+    memcpy(&n, p + fixed_size - sizeof(n), sizeof(n));
+    if (header.body_size != fixed_size + n * update_size) return false;
+    rec.seq          = GetValue<uint64_t>(p);
+    rec.rng_state[0] = GetValue<uint64_t>(p);
+    rec.rng_state[1] = GetValue<uint64_t>(p);
+    rec.batch        = GetValue<uint32_t>(p);
+    p += sizeof(n);
+    rec.updates.clear();
+    for (size_t i = 0; i < n; i++){
+      Update::Type type = Update::Type(GetValue<int32_t>(p));
+      int u = GetValue<int32_t>(p);
+      int v = GetValue<int32_t>(p);
+      rec.updates.emplace_back(type, u, v);
+    }
+    pos = begin + header.body_size;
+    return true;
+  }
+}
@@ -0,0 +1,68 @@
+#ifndef UPDATE_LOG_H
+#define UPDATE_LOG_H
+
+#include "dynamic_centrality_base.hpp"
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <stdint.h>
+using std::vector;
+
+namespace betweenness_centrality {
+
+  // An update (or a batch of updates) as written to the log before it is applied.
+  struct UpdateLogRecord {
+    uint64_t       seq;           // 1 for the first update after PreCompute, 2 for the next, ...
+    uint64_t       rng_state[2];  // of the index and of its reachability index, before the update
+    bool           batch;         // applied with ApplyBatch rather than one by one
+    vector<Update> updates;
+  };
+
+  // Append-only log file. It starts with a header (magic and format version),
+  // and each record carries its size and checksum, so that a record that was
+  // only partly written when the process died is detected and dropped.
+  class UpdateLogWriter {
+  private:
+    FILE        *fp;
+    bool         sync;
+    bool         failed;
+    vector<char> buffer;
+
+  public:
+    // Opens the log at path for appending, dropping everything after its first
+    // valid_size bytes (see UpdateLogReader::ValidSize). If valid_size is 0, a new
+    // empty log is created. With sync, every record is flushed to the disk
+    // rather than only to the OS.
+    UpdateLogWriter(const std::string &path, uint64_t valid_size, bool sync);
+    ~UpdateLogWriter();
+    UpdateLogWriter(const UpdateLogWriter &) = delete;
+    UpdateLogWriter &operator=(const UpdateLogWriter &) = delete;
+
+    inline bool Failed() const { return failed; }
+    // Returns false if the record could not be written.
+    bool Append(const UpdateLogRecord &rec);
+    // Drops all records.
+    bool Truncate();
+  };
+
+  // Reads a whole log into memory and parses it record by record.
+  class UpdateLogReader {
+  private:
+    vector<char> data;
+    size_t       pos;
+    bool         failed;
+
+  public:
+    explicit UpdateLogReader(const std::string &path);
+
+    // Whether the file exists but is not an update log. A missing file reads as an empty log.
+    inline bool Failed() const { return failed; }
+    // Reads the next record. Returns false at the end of the log or at the
+    // first record that is incomplete or broken; the rest is ignored.
+    bool Next(UpdateLogRecord &rec);
+    // The number of bytes of the header and of the records read so far.
+    inline uint64_t ValidSize() const { return pos; }
+  };
+}
+
+#endif /* UPDATE_LOG_H */
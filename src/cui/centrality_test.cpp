@@ -1,4 +1,6 @@
 #include <algorithm>
+#include <climits>
+#include <set>
 #include "gtest/gtest.h"
 #include "algorithm/centrality_base.hpp"
 #include "algorithm/centrality_brandes.hpp"
@@ -16,7 +18,25 @@ protected:
     Centrality bc;
     bc.PreCompute(es, num_samples);
     for (int v = 0; v < int(centrality_values.size()); v++){
-      ASSERT_NEAR(bc.QueryCentrality(v), centrality_values[v], tolerance) << es << " " << v << endl;
+      ASSERT_NEAR(bc.QueryCentrality(v), centrality_values[v], tolerance) << ::testing::PrintToString(es) << " " << v << endl;
+    }
+  }
+  
+  // the bulk export lists every vertex once, as QueryCentrality does
+  template <class Centrality>  void CheckExport(int num_samples = -1){
+    Centrality bc;
+    bc.PreCompute(es, num_samples);
+    vector<pair<int, double> > all;
+    bc.QueryAllCentralities(all);
+    set<int> vs;
+    for (const auto &e : es){
+      vs.insert(e.first);
+      vs.insert(e.second);
+    }
+    ASSERT_EQ(vs.size(), all.size());
+    for (const auto &p : all){
+      ASSERT_EQ(1u, vs.erase(p.first)) << p.first;
+      ASSERT_EQ(bc.QueryCentrality(p.first), p.second) << p.first;
     }
   }
 };
@@ -143,6 +163,26 @@ TEST(BETWEENNESS_ON_SMALL0, EXACT_RENAME){
   ASSERT_NEAR((double)bcn.QueryCentrality(1  ) / 25, 0.00, eps);
 }
 
+TEST(BETWEENNESS_ON_SMALL0, EXACT_SPARSE_RENAME){
+  // labels far apart are renumbered through a hash table instead of a flat one
+  const double eps = 1e-6;
+  const int labels[5] = {INT_MIN, -7, INT_MAX, 0, 1000000};
+  vector<pair<int, int> > es, renamed_es;
+  es.push_back(make_pair(0, 1));
+  es.push_back(make_pair(1, 0));
+  es.push_back(make_pair(1, 2));
+  es.push_back(make_pair(2, 2));
+  es.push_back(make_pair(2, 3));
+  es.push_back(make_pair(3, 4));
+  for (const auto &e : es) renamed_es.push_back(make_pair(labels[e.first], labels[e.second]));
+  betweenness_centrality::CentralityBrandes bcn, renamed_bcn;
+  bcn.PreCompute(es);
+  renamed_bcn.PreCompute(renamed_es);
+  for (int v = 0; v < 5; v++){
+    ASSERT_NEAR(bcn.QueryCentrality(v), renamed_bcn.QueryCentrality(labels[v]), eps) << v;
+  }
+}
+
 TEST_F(SMALL1Test, EXACT){
   Check<betweenness_centrality::CentralityBrandes>(1e-6);
 }
@@ -151,6 +191,10 @@ TEST_F(SMALL1Test, APPROX){
   Check<betweenness_centrality::CentralitySampling>(1e-3 * num_vs * num_vs, 100000);
 }
 
+TEST_F(SMALL1Test, EXPORT){
+  CheckExport<betweenness_centrality::CentralityBrandes>();
+  CheckExport<betweenness_centrality::CentralitySampling>(1000);
+}
 
 TEST(BETWEENNESS_ON_EMPTY, EXACT){
   const double eps = 1e-6;
@@ -216,4 +260,8 @@ TEST_F(BETWEENNESS_ON_UNDIRECTED_GRID, APPROX){
   int num_vs = centrality_values.size();
   Check<betweenness_centrality::CentralitySampling>(3e-2 * num_vs * num_vs, 5000);
 }
+TEST_F(BETWEENNESS_ON_UNDIRECTED_GRID, EXPORT){
+  CheckExport<betweenness_centrality::CentralityBrandes>();
+  CheckExport<betweenness_centrality::CentralitySampling>(1000);
+}
 
@@ -0,0 +1,24 @@
+#include "algorithm/graph_io.hpp"
+#include "gflags/gflags.h"
+#include <iostream>
+using namespace std;
+using namespace betweenness_centrality;
+
+DEFINE_string(input, "", "input graph file (an edge list).");
+DEFINE_string(output, "", "output binary graph file, for dynamic_centrality --graph_format=binary.");
+
+int main(int argc, char *argv[])
+{
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  
+  vector<pair<int, int> > es;
+  if (!ReadTextGraph(FLAGS_input, es)){
+    cerr << FLAGS_input << ": Cannot open input correctly." << endl;
+    exit(EXIT_FAILURE);
+  }
+  if (!WriteBinaryGraph(FLAGS_output, es)){
+    cerr << FLAGS_output << ": Cannot write output." << endl;
+    exit(EXIT_FAILURE);
+  }
+  return 0;
+}
@@ -2,6 +2,7 @@
 #include "algorithm/dynamic_centrality_bms.hpp"
 #include "common.hpp"
 #include "gtest/gtest.h"
+#include <functional>
 #include <memory>
 using namespace betweenness_centrality;
 using namespace std;
@@ -124,3 +125,74 @@ TEST(BMS_ON_GRID_SMALL0, INSERT){
     delete b;
   }
 }
+
+// Builds the index on the vertices of an H x W grid, inserts the edges of
+// the grid in shuffled batches of 5, and calls check after each batch.
+void InsertGridInBatches(size_t H, size_t W, const function<void(DynamicCentralityBMS &)> &check){
+  vector<pair<int, int> > es = GenerateGrid(H, W);
+  vector<pair<int, int> > start_es;
+  for (size_t v = 0; v < H * W; v++){
+    start_es.emplace_back(v, v);
+  }
+  DynamicCentralityBMS b;
+  b.PreCompute(start_es, 2000);
+  std::random_shuffle(es.begin(), es.end());
+  for (size_t i = 0; i < es.size(); i += 5){
+    b.BatchInsert(vector<pair<int, int> >(es.begin() + i, es.begin() + min(es.size(), i + 5)));
+    check(b);
+  }
+}
+
+// TopK of the index against polling every vertex
+TEST(BMS_ON_GRID_SMALL0, TOP_K){
+  size_t H = 7;
+  size_t W = 7;
+  InsertGridInBatches(H, W, [&](DynamicCentralityBMS &b){
+      for (size_t k : {size_t(1), size_t(10), H * W + 1}){
+        auto res      = b.TopK(k);
+        auto expected = b.DynamicCentralityBase::TopK(k);
+        ASSERT_EQ(expected.size(), res.size());
+        for (size_t j = 0; j < res.size(); j++){
+          ASSERT_DOUBLE_EQ(expected[j].snd, res[j].snd);
+          ASSERT_DOUBLE_EQ(b.QueryCentrality(res[j].fst), res[j].snd);
+        }
+      }
+    });
+}
+
+// the bulk export lists every vertex once, as QueryCentrality does
+TEST(BMS_ON_GRID_SMALL0, EXPORT){
+  size_t H = 7;
+  size_t W = 7;
+  InsertGridInBatches(H, W, [&](DynamicCentralityBMS &b){
+      vector<pair<int, double> > all;
+      b.QueryAllCentralities(all);
+      ASSERT_EQ(H * W, all.size());
+      vector<int> seen(H * W, 0);
+      for (const auto &p : all){
+        ASSERT_EQ(0, seen[p.fst]++);
+        ASSERT_EQ(b.QueryCentrality(p.fst), p.snd);
+      }
+    });
+}
+
+// ranks of the raw scores lie within the ties of the rescaled centralities
+TEST(BMS_ON_GRID_SMALL0, RANK){
+  size_t H = 7;
+  size_t W = 7;
+  InsertGridInBatches(H, W, [&](DynamicCentralityBMS &b){
+      for (size_t v = 0; v < H * W; v++){
+        double c = b.QueryCentrality(v);
+        size_t num_greater = 0, num_greater_equal = 0;
+        for (size_t u = 0; u < H * W; u++){
+          num_greater       += b.QueryCentrality(u) >  c;
+          num_greater_equal += b.QueryCentrality(u) >= c;
+        }
+        size_t r = b.Rank(v);
+        ASSERT_LE(num_greater + 1, r);
+        ASSERT_GE(num_greater_equal, r);
+        ASSERT_DOUBLE_EQ(100.0 * (H * W - r + 1) / (H * W), b.Percentile(v));
+      }
+      ASSERT_EQ(0u, b.Rank(H * W));
+    });
+}
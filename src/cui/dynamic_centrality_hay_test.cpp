@@ -1,8 +1,16 @@
 #include "algorithm/dynamic_centrality_base.hpp"
 #include "algorithm/dynamic_centrality_hay.hpp"
 #include "algorithm/dynamic_centrality_naive.hpp"
+#include "algorithm/snapshot.hpp"
 #include "gtest/gtest.h"
 #include <string>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <queue>
+#include <set>
 using namespace betweenness_centrality;
 using namespace std;
 
@@ -180,10 +188,649 @@ void TestVariousBallSize(int H, int W){
   }
 }
 
+void TestParallelUpdate(int V, int num_graphs, double prob, int num_threads){
+  srand(0);
+  DynamicCentralityNaive dcn;
+  DynamicCentralityHAY dch;
+  dch.SetNumThreads(num_threads);
+  while (num_graphs--){
+    vector<pair<int, int> > es(GenerateRandom(V, prob));
+    TestUpdate(&dcn, &dch, es);
+  }
+}
+
+TEST(FAST_SKETCH_PARALLEL, SMALL_RANDOM3){ TestParallelUpdate(10, 10, 0.3, 4); }
+TEST(FAST_SKETCH_PARALLEL, MIDDLE_RANDOM1){ TestParallelUpdate(30, 5, 0.1, 4); }
+TEST(FAST_SKETCH_PARALLEL, MIDDLE_RANDOM3){ TestParallelUpdate(30, 5, 0.3, 3); }
+
+void TestParallelPreCompute(int V, double prob, int num_samples){
+  srand(0);
+  vector<pair<int, int> > es(GenerateRandom(V, prob));
+  DynamicCentralityHAY serial, parallel;
+  parallel.SetNumThreads(4);
+  
+  // the same pairs are sampled, and the scores must be equal to the last bit
+  srand(1);
+  serial.PreCompute(es, num_samples);
+  srand(1);
+  parallel.PreCompute(es, num_samples);
+  for (int v = 0; v < V; v++){
+    ASSERT_EQ(serial.QueryCentrality(v), parallel.QueryCentrality(v)) << v;
+  }
+}
+
+TEST(FAST_SKETCH_PARALLEL, PRECOMPUTE){ TestParallelPreCompute(100, 0.05, 2000); }
+
+void TestSnapshot(int V, double prob, int num_samples){
+  srand(0);
+  vector<pair<int, int> > es(GenerateRandom(V, prob));
+  DynamicCentralityHAY original, restored;
+  original.SetTradeOffParam(1);
+  original.PreCompute(es, num_samples);
+  
+  const string path = "dynamic_centrality_hay_test.snapshot";
+  ASSERT_TRUE(original.Save(path));
+  ASSERT_TRUE(restored.Load(path));
+  for (int v = 0; v < V; v++){
+    ASSERT_EQ(original.QueryCentrality(v), restored.QueryCentrality(v)) << v;
+  }
+  
+  // both must evolve in the same way, including the samples drawn on vertex updates
+  vector<int> queries = GenerateRandomQueries(min((int)es.size() / 2, 30), es);
+  vector<Update> updates;
+  for (int e : queries) updates.emplace_back(Update::DELETE_EDGE, es[e].fst, es[e].snd);
+  for (int e : queries) updates.emplace_back(Update::INSERT_EDGE, es[e].fst, es[e].snd);
+  updates.emplace_back(Update::INSERT_NODE, V);
+  updates.emplace_back(Update::INSERT_EDGE, V, es[0].fst);
+  updates.emplace_back(Update::DELETE_NODE, es[queries[0]].fst);
+  
+  for (const auto &upd : updates){
+    unsigned seed = rand();
+    srand(seed);
+    original.ApplyBatch(vector<Update>(1, upd));
+    srand(seed);
+    restored.ApplyBatch(vector<Update>(1, upd));
+    for (int v = 0; v < V; v++){
+      ASSERT_EQ(original.QueryCentrality(v), restored.QueryCentrality(v)) << v;
+    }
+  }
+  
+  // a damaged snapshot is rejected
+  {
+    fstream fs(path.c_str(), ios::in | ios::out | ios::binary);
+    fs.seekp(100);
+    fs.put('x');
+  }
+  ASSERT_FALSE(restored.Load(path));
+  ASSERT_FALSE(restored.Load(path + ".missing"));
+  remove(path.c_str());
+}
+
+TEST(FAST_SKETCH_SNAPSHOT, SMALL_RANDOM){ TestSnapshot(30, 0.1, 500); }
+TEST(FAST_SKETCH_SNAPSHOT, MIDDLE_RANDOM){ TestSnapshot(100, 0.03, 2000); }
+
+// Writes the first payload_size bytes of the payload of snapshot src (padded
+// with zeros if longer) to dst, with a valid header, so that only parsing can reject it.
+void ResizeSnapshotPayload(const string &src, const string &dst, size_t payload_size){
+  const size_t kHeaderSize = 32; // magic, version, reserved, payload size, checksum
+  ifstream ifs(src.c_str(), ios::binary);
+  string data((istreambuf_iterator<char>(ifs)), istreambuf_iterator<char>());
+  ASSERT_GT(data.size(), kHeaderSize);
+  string payload = data.substr(kHeaderSize);
+  payload.resize(payload_size, '\0');
+  uint64_t size = payload.size(), checksum = Checksum(payload.data(), payload.size());
+  string header = data.substr(0, kHeaderSize);
+  memcpy(&header[16], &size, 8);
+  memcpy(&header[24], &checksum, 8);
+  ofstream ofs(dst.c_str(), ios::binary);
+  ofs << header << payload;
+}
+
+// snapshots that break off in the middle of the hyper-edges, or go on after
+// them, are rejected after some hyper-edges were already restored
+void TestBrokenSnapshot(int V, double prob, int num_samples){
+  srand(0);
+  vector<pair<int, int> > es(GenerateRandom(V, prob));
+  DynamicCentralityHAY original, used;
+  original.PreCompute(es, num_samples);
+  used.PreCompute(es, num_samples / 2);
+  
+  const string path = "dynamic_centrality_hay_test.snapshot";
+  const string broken_path = path + ".broken";
+  ASSERT_TRUE(original.Save(path));
+  size_t payload_size;
+  {
+    ifstream ifs(path.c_str(), ios::binary | ios::ate);
+    payload_size = (size_t)ifs.tellg() - 32;
+  }
+  for (size_t size : {payload_size / 2, payload_size * 9 / 10, payload_size - 1, payload_size + 8}){
+    ResizeSnapshotPayload(path, broken_path, size);
+    DynamicCentralityHAY fresh;
+    ASSERT_FALSE(fresh.Load(broken_path)) << size;
+    ASSERT_FALSE(used.Load(broken_path)) << size;
+    ASSERT_EQ(0u, used.GetNumQueriers());
+    
+    // both stay usable
+    ASSERT_TRUE(fresh.Load(path));
+    for (int v = 0; v < V; v++){
+      ASSERT_EQ(original.QueryCentrality(v), fresh.QueryCentrality(v)) << v;
+    }
+  }
+  ASSERT_TRUE(used.Load(path));
+  for (int v = 0; v < V; v++){
+    ASSERT_EQ(original.QueryCentrality(v), used.QueryCentrality(v)) << v;
+  }
+  remove(path.c_str());
+  remove(broken_path.c_str());
+}
+
+TEST(FAST_SKETCH_SNAPSHOT, BROKEN_SMALL_RANDOM){ TestBrokenSnapshot(30, 0.1, 500); }
+TEST(FAST_SKETCH_SNAPSHOT, BROKEN_MIDDLE_RANDOM){ TestBrokenSnapshot(100, 0.03, 2000); }
+
+void ApplyUpdates(DynamicCentralityHAY &dch, const vector<Update> &updates, size_t begin, size_t end, size_t batch_size){
+  for (size_t i = begin; i < end; i += batch_size){
+    vector<Update> batch(updates.begin() + i, updates.begin() + min(end, i + batch_size));
+    if (batch.size() == 1){
+      dch.DynamicCentralityBase::ApplyBatch(batch);
+    } else {
+      dch.ApplyBatch(batch);
+    }
+  }
+}
+
+void TestRecovery(int V, double prob, int num_samples){
+  srand(0);
+  vector<pair<int, int> > es(GenerateRandom(V, prob));
+  vector<int> queries = GenerateRandomQueries(min((int)es.size() / 2, 30), es);
+  vector<Update> updates;
+  for (int e : queries) updates.emplace_back(Update::DELETE_EDGE, es[e].fst, es[e].snd);
+  updates.emplace_back(Update::INSERT_NODE, V);
+  updates.emplace_back(Update::INSERT_EDGE, V, es[0].fst);
+  for (int e : queries) updates.emplace_back(Update::INSERT_EDGE, es[e].fst, es[e].snd);
+  updates.emplace_back(Update::DELETE_NODE, es[queries[0]].fst);
+  const size_t n = updates.size();
+
+  // the same index without a log
+  DynamicCentralityHAY expected;
+  srand(1);
+  expected.PreCompute(es, num_samples);
+  ApplyUpdates(expected, updates, 0, n / 3, 1);
+  ApplyUpdates(expected, updates, n / 3, n * 2 / 3, 4);
+
+  const string checkpoint_path = "dynamic_centrality_hay_test.checkpoint";
+  const string log_path        = "dynamic_centrality_hay_test.log";
+  remove(log_path.c_str());
+  {
+    DynamicCentralityHAY crashed;
+    srand(1);
+    crashed.PreCompute(es, num_samples);
+    ASSERT_TRUE(crashed.Checkpoint(checkpoint_path));
+    ASSERT_TRUE(crashed.OpenUpdateLog(log_path));
+    ApplyUpdates(crashed, updates, 0, n / 3, 1);
+    ASSERT_TRUE(crashed.Checkpoint(checkpoint_path));
+    ApplyUpdates(crashed, updates, n / 3, n * 2 / 3, 4);
+  }
+  {
+    // a record that was being written when the process died
+    ofstream ofs(log_path.c_str(), ios::app | ios::binary);
+    ofs << "torn";
+  }
+
+  DynamicCentralityHAY recovered;
+  ASSERT_TRUE(recovered.Recover(checkpoint_path, log_path));
+  ASSERT_EQ(expected.GetNumUpdates(), recovered.GetNumUpdates());
+  for (int v = 0; v <= V; v++){
+    ASSERT_EQ(expected.QueryCentrality(v), recovered.QueryCentrality(v)) << v;
+  }
+
+  // the log goes on after the torn record was dropped
+  ApplyUpdates(expected,  updates, n * 2 / 3, n, 1);
+  ApplyUpdates(recovered, updates, n * 2 / 3, n, 1);
+  DynamicCentralityHAY recovered_again;
+  ASSERT_TRUE(recovered_again.Recover(checkpoint_path, log_path));
+  for (int v = 0; v <= V; v++){
+    ASSERT_EQ(expected.QueryCentrality(v), recovered.QueryCentrality(v)) << v;
+    ASSERT_EQ(expected.QueryCentrality(v), recovered_again.QueryCentrality(v)) << v;
+  }
+
+  // a log that does not continue the index is rejected
+  expected.PreCompute(es, num_samples);
+  ASSERT_FALSE(expected.OpenUpdateLog(log_path));
+  remove(checkpoint_path.c_str());
+  remove(log_path.c_str());
+}
+
+TEST(FAST_SKETCH_RECOVERY, SMALL_RANDOM){ TestRecovery(30, 0.1, 500); }
+TEST(FAST_SKETCH_RECOVERY, MIDDLE_RANDOM){ TestRecovery(100, 0.03, 2000); }
+
+void TestBatchUpdate(DynamicCentralityBase *a, DynamicCentralityBase *b, const vector<pair<int, int> > &es, int batch_size){
+  int V = 0;
+  for (const auto &e : es){
+    V = max({V, e.fst + 1, e.snd + 1});
+  }
+  
+  const double tolerance = 1e-5;
+  a->PreCompute(es, -1);
+  b->PreCompute(es, -1);
+  
+  vector<int> queries = GenerateRandomQueries(min((int)es.size() / 2, 30), es);
+  vector<Update> updates;
+  for (int e : queries){
+    updates.emplace_back(Update::DELETE_EDGE, es[e].fst, es[e].snd);
+  }
+  // re-insert half of the deleted edges, interleaved with the remaining deletions
+  for (size_t i = 0; i < queries.size(); i += 2){
+    updates.emplace_back(Update::INSERT_EDGE, es[queries[i]].fst, es[queries[i]].snd);
+  }
+  
+  for (size_t i = 0; i < updates.size(); i += batch_size){
+    vector<Update> batch(updates.begin() + i, updates.begin() + min(updates.size(), i + batch_size));
+    a->ApplyBatch(batch);
+    b->ApplyBatch(batch);
+    CheckError(a, b, V, tolerance);
+  }
+}
+
+void TestBatchUpdateOnRandomGraph(int V, int num_graphs, double prob, int batch_size){
+  srand(0);
+  DynamicCentralityNaive dcn;
+  DynamicCentralityHAY dch;
+  while (num_graphs--){
+    vector<pair<int, int> > es(GenerateRandom(V, prob));
+    TestBatchUpdate(&dcn, &dch, es, batch_size);
+  }
+}
+
+TEST(FAST_SKETCH_BATCH, SMALL_RANDOM3){ TestBatchUpdateOnRandomGraph(10, 10, 0.3, 5); }
+TEST(FAST_SKETCH_BATCH, MIDDLE_RANDOM1){ TestBatchUpdateOnRandomGraph(30, 5, 0.1, 10); }
+TEST(FAST_SKETCH_BATCH, MIDDLE_RANDOM3){ TestBatchUpdateOnRandomGraph(30, 5, 0.3, 45); }
+
+// Random insertions and deletions, where a batch may insert an edge and delete it
+// again. The single updates after each batch work on the balls that it repaired.
+void TestMixedBatchUpdate(int V, int num_graphs, double prob, int num_batches, int batch_size){
+  srand(0);
+  const double tolerance = 1e-5;
+  DynamicCentralityNaive dcn;
+  DynamicCentralityHAY dch;
+  while (num_graphs--){
+    vector<pair<int, int> > es(GenerateRandom(V, prob));
+    set<pair<int, int> > edges(es.begin(), es.end());
+    set<int> vertices;
+    for (const auto &e : es){
+      vertices.insert(e.fst);
+      vertices.insert(e.snd);
+    }
+    vector<int> vs(vertices.begin(), vertices.end());
+    dcn.PreCompute(es, -1);
+    dch.PreCompute(es, -1);
+    
+    auto toggle = [&](){
+      int u = vs[rand() % vs.size()], v = u;
+      while (v == u) v = vs[rand() % vs.size()];
+      bool present = edges.erase(make_pair(u, v));
+      if (!present) edges.insert(make_pair(u, v));
+      return Update(present ? Update::DELETE_EDGE : Update::INSERT_EDGE, u, v);
+    };
+    
+    for (int i = 0; i < num_batches; i++){
+      vector<Update> batch;
+      for (int j = 0; j < batch_size; j++) batch.push_back(toggle());
+      dcn.ApplyBatch(batch);
+      dch.ApplyBatch(batch);
+      CheckError(&dcn, &dch, V, tolerance);
+      
+      for (int j = 0; j < 2; j++){
+        vector<Update> single(1, toggle());
+        dcn.ApplyBatch(single);
+        dch.DynamicCentralityBase::ApplyBatch(single);
+        CheckError(&dcn, &dch, V, tolerance);
+      }
+    }
+  }
+}
+
+TEST(FAST_SKETCH_BATCH, MIXED_SMALL_RANDOM3){ TestMixedBatchUpdate(10, 10, 0.3, 10, 8); }
+TEST(FAST_SKETCH_BATCH, MIXED_MIDDLE_RANDOM1){ TestMixedBatchUpdate(30, 5, 0.1, 10, 20); }
+TEST(FAST_SKETCH_BATCH, MIXED_MIDDLE_RANDOM3){ TestMixedBatchUpdate(30, 5, 0.3, 5, 40); }
+
+// queriers are only kept for disconnected pairs, and go away with their hyper-edges
+void TestQuerierLifecycle(int V, double prob, int num_samples){
+  srand(0);
+  vector<pair<int, int> > es(GenerateRandom(V, prob));
+  DynamicCentralityHAY dch;
+  dch.PreCompute(es, num_samples);
+  ASSERT_GT(dch.GetNumDisconnectedPairs(), 0u);
+  ASSERT_EQ(dch.GetNumDisconnectedPairs(), dch.GetNumQueriers());
+  
+  vector<int> queries = GenerateRandomQueries(min((int)es.size() / 2, 30), es);
+  for (int e : queries){
+    dch.DeleteEdge(es[e].fst, es[e].snd);
+    ASSERT_EQ(dch.GetNumDisconnectedPairs(), dch.GetNumQueriers());
+  }
+  for (int e : queries){
+    dch.InsertEdge(es[e].fst, es[e].snd);
+    ASSERT_EQ(dch.GetNumDisconnectedPairs(), dch.GetNumQueriers());
+  }
+  // resamples the pairs of the deleted vertices
+  for (int v = 0; v < V; v += 7){
+    dch.DeleteNode(v);
+    ASSERT_EQ(dch.GetNumDisconnectedPairs(), dch.GetNumQueriers());
+  }
+}
+
+TEST(FAST_SKETCH_QUERIER, SMALL_RANDOM){ TestQuerierLifecycle(30, 0.05, 500); }
+TEST(FAST_SKETCH_QUERIER, MIDDLE_RANDOM){ TestQuerierLifecycle(100, 0.02, 2000); }
+
+// The score of each vertex in vs against the sum of its dependencies on the
+// sampled pairs, counted by a BFS from the source and one to the target of each pair.
+void CheckSampledWeights(const DynamicCentralityHAY &dch, const vector<pair<int, int> > &es, const set<int> &vs){
+  map<int, vector<int> > adj[2];
+  for (const auto &e : es){
+    adj[0][e.fst].push_back(e.snd);
+    adj[1][e.snd].push_back(e.fst);
+  }
+  auto bfs = [&](int s, int dir, map<int, int> &dist, map<int, double> &num_paths){
+    queue<int> que;
+    que.push(s);
+    dist[s] = 0;
+    num_paths[s] = 1;
+    while (!que.empty()){
+      int v = que.front(); que.pop();
+      for (int w : adj[dir][v]){
+        if (dist.count(w) == 0){
+          dist[w] = dist[v] + 1;
+          que.push(w);
+        }
+        if (dist[w] == dist[v] + 1) num_paths[w] += num_paths[v];
+      }
+    }
+  };
+  
+  vector<pair<int, int> > pairs = dch.GetSampledPairs();
+  map<int, double> dependency;
+  for (const auto &p : pairs){
+    map<int, int>    dist[2];
+    map<int, double> num_paths[2];
+    bfs(p.fst, 0, dist[0], num_paths[0]);
+    bfs(p.snd, 1, dist[1], num_paths[1]);
+    if (p.fst == p.snd || dist[0].count(p.snd) == 0) continue;
+    for (const auto &q : dist[0]){
+      int v = q.fst;
+      if (v != p.fst && v != p.snd && dist[1].count(v) && q.snd + dist[1][v] == dist[0][p.snd]){
+        dependency[v] += num_paths[0][v] * num_paths[1][v] / num_paths[0][p.snd];
+      }
+    }
+  }
+  double n = vs.size();
+  for (int v : vs){
+    ASSERT_NEAR(dependency[v] / pairs.size() * n * n, dch.QueryCentrality(v), 1e-9 * n * n) << v;
+  }
+}
+
+// Vertex updates resample hyper-edges, and the weights of the replaced ones
+// are subtracted when they are deleted, so only the live ones make up the scores.
+void TestSampledWeights(int V, double prob, int num_samples){
+  srand(0);
+  vector<pair<int, int> > es(GenerateRandom(V, prob));
+  set<int> vs;
+  for (const auto &e : es){
+    vs.insert(e.fst);
+    vs.insert(e.snd);
+  }
+  DynamicCentralityHAY dch;
+  dch.PreCompute(es, num_samples);
+  CheckSampledWeights(dch, es, vs);
+  
+  for (int i = 0; i < 5; i++){
+    int u = V + i, w = es[rand() % es.size()].fst;
+    dch.InsertNode(u);
+    dch.InsertEdge(u, w);
+    dch.InsertEdge(w, u);
+    es.emplace_back(u, w);
+    es.emplace_back(w, u);
+    vs.insert(u);
+    CheckSampledWeights(dch, es, vs);
+  }
+  for (int v = 0; v < V; v += 7){
+    if (vs.erase(v) == 0) continue;
+    dch.DeleteNode(v);
+    es.erase(remove_if(es.begin(), es.end(), [&](const pair<int, int> &e){ return e.fst == v || e.snd == v; }), es.end());
+    CheckSampledWeights(dch, es, vs);
+  }
+}
+
+TEST(FAST_SKETCH_RESAMPLE, SMALL_RANDOM){ TestSampledWeights(30, 0.1, 500); }
+TEST(FAST_SKETCH_RESAMPLE, MIDDLE_RANDOM){ TestSampledWeights(60, 0.05, 1000); }
+
+// Applies edge deletions and insertions, and then vertex insertions and
+// deletions, to the index of the graph es, and calls check with the vertices
+// that exist before the updates and after each of them.
+void ApplyScoreUpdates(DynamicCentralityHAY &dch, int V, const vector<pair<int, int> > &es,
+                       const function<void(const set<int> &)> &check){
+  set<int> vs;
+  for (const auto &e : es){
+    vs.insert(e.fst);
+    vs.insert(e.snd);
+  }
+  check(vs);
+  
+  vector<int> queries = GenerateRandomQueries(min((int)es.size() / 2, 30), es);
+  for (int e : queries){
+    dch.DeleteEdge(es[e].fst, es[e].snd);
+    check(vs);
+  }
+  for (int e : queries){
+    dch.InsertEdge(es[e].fst, es[e].snd);
+    check(vs);
+  }
+  for (int i = 0; i < 5; i++){
+    dch.InsertNode(V + i);
+    dch.InsertEdge(V + i, rand() % V);
+    dch.InsertEdge(rand() % V, V + i);
+    vs.insert(V + i);
+    check(vs);
+  }
+  for (int v = 0; v < V; v += 7){
+    dch.DeleteNode(v);
+    vs.erase(v);
+    check(vs);
+  }
+}
+
+// TopK of the index against polling every vertex (the default of DynamicCentralityBase)
+void CheckTopK(const DynamicCentralityHAY &dch, size_t k){
+  auto res      = dch.TopK(k);
+  auto expected = dch.DynamicCentralityBase::TopK(k);
+  ASSERT_EQ(expected.size(), res.size());
+  for (size_t i = 0; i < res.size(); i++){
+    ASSERT_DOUBLE_EQ(expected[i].snd, res[i].snd) << i;
+    ASSERT_DOUBLE_EQ(dch.QueryCentrality(res[i].fst), res[i].snd) << i;
+  }
+}
+
+void TestTopK(int V, double prob, int num_samples, int num_threads){
+  srand(0);
+  vector<pair<int, int> > es(GenerateRandom(V, prob));
+  DynamicCentralityHAY dch;
+  dch.SetNumThreads(num_threads);
+  dch.PreCompute(es, num_samples);
+  // new vertices are listed, and deleted ones are not
+  ApplyScoreUpdates(dch, V, es, [&](const set<int> &vs){
+      CheckTopK(dch, 10);
+      CheckTopK(dch, vs.size() + 1);
+    });
+}
+
+TEST(FAST_SKETCH_TOP_K, SMALL_RANDOM){ TestTopK(30, 0.1, 500, 1); }
+TEST(FAST_SKETCH_TOP_K, MIDDLE_RANDOM){ TestTopK(100, 0.03, 2000, 1); }
+TEST(FAST_SKETCH_TOP_K, THREADS){ TestTopK(100, 0.03, 2000, 4); }
+
+// the bulk export lists each vertex in vs once, as QueryCentrality does
+void CheckAllCentralities(const DynamicCentralityHAY &dch, set<int> vs){
+  vector<pair<int, double> > all;
+  dch.QueryAllCentralities(all);
+  ASSERT_EQ(vs.size(), all.size());
+  for (const auto &p : all){
+    ASSERT_EQ(1u, vs.erase(p.fst)) << p.fst;
+    ASSERT_EQ(dch.QueryCentrality(p.fst), p.snd) << p.fst;
+  }
+}
+
+void TestAllCentralities(int V, double prob, int num_samples){
+  srand(0);
+  vector<pair<int, int> > es(GenerateRandom(V, prob));
+  DynamicCentralityHAY dch;
+  dch.PreCompute(es, num_samples);
+  ApplyScoreUpdates(dch, V, es, [&](const set<int> &vs){ CheckAllCentralities(dch, vs); });
+}
+
+TEST(FAST_SKETCH_EXPORT, SMALL_RANDOM){ TestAllCentralities(30, 0.1, 500); }
+TEST(FAST_SKETCH_EXPORT, MIDDLE_RANDOM){ TestAllCentralities(100, 0.03, 2000); }
+
+// Rank orders the raw scores, so it can only differ from the order of the
+// rescaled centralities where rounding makes two of them equal
+void CheckRank(const DynamicCentralityHAY &dch, const set<int> &vs, int V){
+  vector<pair<int, double> > all;
+  for (int v : vs) all.emplace_back(v, dch.QueryCentrality(v));
+  for (int v = 0; v < 2 * V; v++){
+    if (vs.count(v) == 0){
+      ASSERT_EQ(0u, dch.Rank(v)) << v;
+      ASSERT_EQ(0.0, dch.Percentile(v)) << v;
+      continue;
+    }
+    double c = dch.QueryCentrality(v);
+    size_t num_greater = 0, num_greater_equal = 0;
+    for (const auto &p : all){
+      num_greater       += p.snd >  c;
+      num_greater_equal += p.snd >= c;
+    }
+    size_t r = dch.Rank(v);
+    ASSERT_LE(num_greater + 1, r) << v;
+    ASSERT_GE(num_greater_equal, r) << v;
+    ASSERT_DOUBLE_EQ(100.0 * (vs.size() - r + 1) / vs.size(), dch.Percentile(v)) << v;
+  }
+}
+
+void TestRank(int V, double prob, int num_samples, int num_threads){
+  srand(0);
+  vector<pair<int, int> > es(GenerateRandom(V, prob));
+  DynamicCentralityHAY dch;
+  dch.SetNumThreads(num_threads);
+  dch.PreCompute(es, num_samples);
+  ApplyScoreUpdates(dch, V, es, [&](const set<int> &vs){ CheckRank(dch, vs, V); });
+}
+
+TEST(FAST_SKETCH_RANK, SMALL_RANDOM){ TestRank(30, 0.1, 500, 1); }
+TEST(FAST_SKETCH_RANK, MIDDLE_RANDOM){ TestRank(100, 0.03, 2000, 1); }
+TEST(FAST_SKETCH_RANK, THREADS){ TestRank(100, 0.03, 2000, 4); }
+
+// the watches report exactly the crossings that polling every vertex before and after each update finds
+void TestWatches(int V, double prob, int num_samples, int batch_size){
+  srand(0);
+  vector<pair<int, int> > es(GenerateRandom(V, prob));
+  DynamicCentralityHAY dch;
+  dch.PreCompute(es, num_samples);
+  
+  struct WatchSpec { int vertex; double threshold; CrossingDirection direction; };
+  vector<WatchSpec> specs;
+  vector<pair<int, int> > received;
+  auto add = [&](int vertex, double threshold, CrossingDirection direction){
+    int id = dch.AddWatch(vertex, threshold, direction, [&](const CrossingEvent &e){
+        ASSERT_EQ(dch.QueryCentrality(e.vertex), e.new_centrality);
+        received.emplace_back(e.watch_id, e.vertex);
+      });
+    ASSERT_EQ((int)specs.size(), id);
+    specs.push_back(WatchSpec{vertex, threshold, direction});
+  };
+  vector<double> cs;
+  for (int v = 0; v < V; v++) cs.push_back(dch.QueryCentrality(v));
+  sort(cs.begin(), cs.end());
+  add(CentralityWatches::kAllVertices, cs[V / 2], BOTH_DIRECTIONS);
+  add(CentralityWatches::kAllVertices, cs[V * 9 / 10], UPWARD);
+  for (int v = 0; v < V; v += 5){
+    add(v, dch.QueryCentrality(v), v % 2 ? UPWARD : DOWNWARD);
+  }
+  
+  vector<Update> updates;
+  vector<int> queries = GenerateRandomQueries(min((int)es.size() / 2, 30), es);
+  for (int e : queries) updates.emplace_back(Update::DELETE_EDGE, es[e].fst, es[e].snd);
+  for (int i = 0; i < 3; i++){
+    updates.emplace_back(Update::INSERT_NODE, V + i);
+    updates.emplace_back(Update::INSERT_EDGE, V + i, rand() % V);
+    updates.emplace_back(Update::INSERT_EDGE, rand() % V, V + i);
+  }
+  for (int e : queries) updates.emplace_back(Update::INSERT_EDGE, es[e].fst, es[e].snd);
+  for (int v = 1; v < V; v += 9) updates.emplace_back(Update::DELETE_NODE, v);
+  
+  size_t num_events = 0;
+  vector<char> removed(specs.size(), false);
+  for (size_t i = 0; i < updates.size(); i += batch_size){
+    vector<double> prev;
+    for (int v = 0; v < V + 3; v++) prev.push_back(dch.QueryCentrality(v));
+    vector<Update> batch(updates.begin() + i, updates.begin() + min(updates.size(), i + batch_size));
+    if (batch_size == 1){
+      const Update &upd = batch[0];
+      switch (upd.type){
+      case Update::INSERT_NODE: dch.InsertNode(upd.u); break;
+      case Update::DELETE_NODE: dch.DeleteNode(upd.u); break;
+      case Update::INSERT_EDGE: dch.InsertEdge(upd.u, upd.v); break;
+      case Update::DELETE_EDGE: dch.DeleteEdge(upd.u, upd.v); break;
+      }
+    } else {
+      dch.ApplyBatch(batch);
+    }
+    
+    vector<pair<int, int> > expected;
+    for (size_t id = 0; id < specs.size(); id++){
+      if (removed[id]) continue;
+      for (int v = 0; v < V + 3; v++){
+        if (specs[id].vertex != CentralityWatches::kAllVertices && specs[id].vertex != v) continue;
+        double t = specs[id].threshold, curr = dch.QueryCentrality(v);
+        bool up   = prev[v] <  t && curr >= t;
+        bool down = prev[v] >= t && curr <  t;
+        if ((up && specs[id].direction != DOWNWARD) || (down && specs[id].direction != UPWARD)){
+          expected.emplace_back(id, v);
+        }
+      }
+    }
+    sort(expected.begin(), expected.end());
+    sort(received.begin(), received.end());
+    ASSERT_EQ(expected, received) << i;
+    num_events += received.size();
+    received.clear();
+    
+    // removed watches fall silent
+    if (i / batch_size == 10){
+      ASSERT_TRUE(dch.RemoveWatch(0));
+      ASSERT_FALSE(dch.RemoveWatch(0));
+      removed[0] = true;
+    }
+  }
+  ASSERT_GT(num_events, 0u);
+}
+
+TEST(FAST_SKETCH_WATCH, SMALL_RANDOM){ TestWatches(30, 0.1, 500, 1); }
+TEST(FAST_SKETCH_WATCH, MIDDLE_RANDOM){ TestWatches(100, 0.03, 2000, 1); }
+TEST(FAST_SKETCH_WATCH, BATCH){ TestWatches(100, 0.03, 2000, 7); }
+
+void TestVariousBallSizeOnRandomGraph(int V, double prob){
+  srand(0);
+  vector<pair<int, int> > es(GenerateRandom(V, prob));
+  DynamicCentralityNaive dcn;
+  DynamicCentralityHAY dch;
+  
+  for (int x = 0; x < 5; x++){
+    dch.SetTradeOffParam(x);
+    TestUpdate(&dcn, &dch, es);
+  }
+}
+
 TEST(FAST_SKETCH_BALL_SIZE, TINY_GRID1){ TestVariousBallSize(2, 4); }
 TEST(FAST_SKETCH_BALL_SIZE, TINY_GRID2){ TestVariousBallSize(3, 3); }
 TEST(FAST_SKETCH_BALL_SIZE, SMALL_GRID1){ TestVariousBallSize(4, 4); }
 TEST(FAST_SKETCH_BALL_SIZE, SMALL_GRID2){ TestVariousBallSize(5, 3); }
+TEST(FAST_SKETCH_BALL_SIZE, SMALL_RANDOM1){ TestVariousBallSizeOnRandomGraph(15, 0.1); }
+TEST(FAST_SKETCH_BALL_SIZE, SMALL_RANDOM2){ TestVariousBallSizeOnRandomGraph(20, 0.08); }
 // TEST(FAST_SKETCH_BALL_SIZE, MIDDLE_GRID1){ TestVariousBallSize(5, 10); }
 // TEST(FAST_SKETCH_BALL_SIZE, MIDDLE_GRID2){ TestVariousBallSize(7, 7); }
 
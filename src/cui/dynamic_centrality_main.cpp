@@ -4,67 +4,152 @@
 #include "gflags/gflags.h"
 #include <iostream>
 #include <fstream>
+#include <cstdio>
 using namespace std;
 using namespace betweenness_centrality;
+using namespace betweenness_centrality::special_purpose_reachability_index;
 
 DEFINE_string(graph_file, "-", "input graph file.");
+DEFINE_string(graph_format, "text", "text (an edge list) or binary (written by convert_graph).");
 DEFINE_string(query_file, "-", "input query file.");
 DEFINE_string(algorithm, "hay", "naive, bms, or hay");
 DEFINE_int32(num_samples, 1000, "the number of samples used to estimate centrality values.");
+DEFINE_int32(num_threads, 1, "the number of threads used to build and update the index (hay only).");
+DEFINE_int32(batch_size, 1, "the maximum number of consecutive updates applied as one batch (1: apply each update on its own).");
+DEFINE_string(load_index, "", "load the index from this snapshot instead of building it from graph_file (hay only).");
+DEFINE_string(save_index, "", "save the index to this snapshot before processing queries (hay only).");
+DEFINE_string(checkpoint_file, "", "recover the index from this checkpoint and update_log if it exists, and write checkpoints to it (hay only).");
+DEFINE_string(update_log, "", "log every update to this file before applying it, for recovery with checkpoint_file (hay only).");
+DEFINE_int32(checkpoint_interval, 0, "write a checkpoint every this number of logged updates or batches (0: only at the start).");
+DEFINE_int32(num_roots, 10, "the number of roots of the reachability index (hay only).");
+DEFINE_string(root_selection, "random", "random, degree or scc: how the roots of the reachability index are chosen (hay only).");
+DEFINE_int32(root_adapt_interval, 0, "replace a root that rarely prunes searches after this number of tested vertices (0: never, hay only).");
+DEFINE_bool(huge_pages, false, "back the memory pool of hyper-edges with transparent huge pages (hay only).");
 
 
+RootSelection GetRootSelectionFromName(const string &name){
+  if (name == "random"){
+    return RANDOM_ROOTS;
+  } else if (name == "degree"){
+    return DEGREE_ROOTS;
+  } else if (name == "scc"){
+    return SCC_ROOTS;
+  } else {
+    cerr << "A root selection does not exist." << endl;
+    exit(EXIT_FAILURE);
+  }
+}
+
 DynamicCentralityBase *GetAlgorithmFromName(const string &algo_name){
   if (algo_name == "naive"){
     return new DynamicCentralityNaive();
   } else if (algo_name == "bms"){
     return new DynamicCentralityBMS();
   } else if (algo_name == "hay"){
-    return new DynamicCentralityHAY();
+    MemoryPool::SetUseHugePages(FLAGS_huge_pages);
+    DynamicCentralityHAY *dch = new DynamicCentralityHAY();
+    dch->SetNumThreads(FLAGS_num_threads);
+    dch->SetReachabilityRoots(FLAGS_num_roots, GetRootSelectionFromName(FLAGS_root_selection));
+    dch->SetRootAdaptInterval(FLAGS_root_adapt_interval);
+    return dch;
   } else {
     cerr << "An algorithm does not exist." << endl;
     exit(EXIT_FAILURE);
   }
 }
 
-void ReadGraph(const string &graph_file, vector<pair<int, int> > &es){
-  ifstream ifs(graph_file);
-  
-  if (!ifs.good()){
-    cerr << graph_file << ": Cannot open graph_file correctly." << endl;
+void BuildFromGraphFile(const string &graph_file, DynamicCentralityBase *dcb){
+  if (FLAGS_graph_format == "binary"){
+    MappedGraph graph;
+    if (!graph.Open(graph_file)){
+      cerr << graph_file << ": Cannot map graph_file as a binary graph." << endl;
+      exit(EXIT_FAILURE);
+    }
+    dcb->PreCompute(graph, FLAGS_num_samples);
+  } else if (FLAGS_graph_format == "text"){
+    vector<pair<int, int> > es;
+    if (!ReadTextGraph(graph_file, es)){
+      cerr << graph_file << ": Cannot open graph_file correctly." << endl;
+      exit(EXIT_FAILURE);
+    }
+    dcb->PreCompute(es, FLAGS_num_samples);
+  } else {
+    cerr << "A graph format does not exist." << endl;
     exit(EXIT_FAILURE);
   }
-  es.clear();
-
-  for (int u, v; ifs >> u >> v; ){
-    es.emplace_back(u, v);
-  }
-  ifs.close();
 }
 
 void ProcessQueries(istream &is, DynamicCentralityBase *cb){
   string q;
+  vector<Update> batch;
+  DynamicCentralityHAY *dch = dynamic_cast<DynamicCentralityHAY*>(cb);
+  uint64_t last_checkpoint = dch != nullptr ? dch->GetNumUpdates() : 0;
+  auto flush = [&](){
+    // single updates keep to the incremental methods; ApplyBatch only pays off for real batches
+    if (batch.size() == 1){
+      const Update &upd = batch[0];
+      switch (upd.type){
+      case Update::INSERT_NODE: cb->InsertNode(upd.u); break;
+      case Update::DELETE_NODE: cb->DeleteNode(upd.u); break;
+      case Update::INSERT_EDGE: cb->InsertEdge(upd.u, upd.v); break;
+      case Update::DELETE_EDGE: cb->DeleteEdge(upd.u, upd.v); break;
+      }
+    } else if (!batch.empty()){
+      cb->ApplyBatch(batch);
+    }
+    batch.clear();
+    if (dch != nullptr && !FLAGS_checkpoint_file.empty() && FLAGS_checkpoint_interval > 0 &&
+        dch->GetNumUpdates() >= last_checkpoint + FLAGS_checkpoint_interval){
+      if (!dch->Checkpoint(FLAGS_checkpoint_file)){
+        cerr << FLAGS_checkpoint_file << ": Cannot write a checkpoint." << endl;
+        exit(EXIT_FAILURE);
+      }
+      last_checkpoint = dch->GetNumUpdates();
+    }
+  };
+  
   while (is >> q){
     int u, v;
     if (q == "Q"){
       is >> v;
+      flush();
       cout << cb->QueryCentrality(v) << endl;
+    } else if (q == "T"){
+      // the k most central vertices, one "vertex centrality" per line
+      is >> v;
+      flush();
+      for (const auto &p : cb->TopK(max(v, 0))) cout << p.fst << " " << p.snd << endl;
+    } else if (q == "R"){
+      // "rank percentile" of v
+      is >> v;
+      flush();
+      cout << cb->Rank(v) << " " << cb->Percentile(v) << endl;
+    } else if (q == "A"){
+      // every vertex, one "vertex centrality" per line
+      flush();
+      vector<pair<int, double> > all;
+      cb->QueryAllCentralities(all);
+      for (const auto &p : all) cout << p.fst << " " << p.snd << "\n";
+      cout.flush();
     } else if (q == "VI"){
       is >> v;
-      cb->InsertNode(v);
+      batch.emplace_back(Update::INSERT_NODE, v);
     } else if (q == "VD"){
       is >> v;
-      cb->DeleteNode(v);
+      batch.emplace_back(Update::DELETE_NODE, v);
     } else if (q == "EI"){
       is >> u >> v;
-      cb->InsertEdge(u, v);
+      batch.emplace_back(Update::INSERT_EDGE, u, v);
     } else if (q == "ED"){
       is >> u >> v;
-      cb->DeleteEdge(u, v);
+      batch.emplace_back(Update::DELETE_EDGE, u, v);
     } else {
       getline(is, q);           // dummy
       cerr << "Warning: invalid operation." << endl;
     }
+    if ((int)batch.size() >= FLAGS_batch_size) flush();
   }
+  flush();
 }
 
 int main(int argc, char *argv[])
@@ -73,9 +158,46 @@ int main(int argc, char *argv[])
   
   DynamicCentralityBase *dcb = GetAlgorithmFromName(FLAGS_algorithm);
   
-  vector<pair<int, int> > es;
-  ReadGraph(FLAGS_graph_file, es);
-  dcb->PreCompute(es, FLAGS_num_samples);
+  DynamicCentralityHAY *dch = dynamic_cast<DynamicCentralityHAY*>(dcb);
+  if ((!FLAGS_load_index.empty() || !FLAGS_save_index.empty() || !FLAGS_checkpoint_file.empty()) && dch == nullptr){
+    cerr << "Snapshots are only supported by hay." << endl;
+    exit(EXIT_FAILURE);
+  }
+  if (!FLAGS_update_log.empty() && FLAGS_checkpoint_file.empty()){
+    cerr << "update_log requires checkpoint_file." << endl;
+    exit(EXIT_FAILURE);
+  }
+  
+  bool recovered = false;
+  if (!FLAGS_checkpoint_file.empty() && ifstream(FLAGS_checkpoint_file).good()){
+    recovered = FLAGS_update_log.empty() ? dch->Load(FLAGS_checkpoint_file) : dch->Recover(FLAGS_checkpoint_file, FLAGS_update_log);
+    if (!recovered){
+      cerr << FLAGS_checkpoint_file << ": Cannot recover the index." << endl;
+      exit(EXIT_FAILURE);
+    }
+  } else if (!FLAGS_load_index.empty()){
+    if (!dch->Load(FLAGS_load_index)){
+      cerr << FLAGS_load_index << ": Cannot load the index." << endl;
+      exit(EXIT_FAILURE);
+    }
+  } else {
+    BuildFromGraphFile(FLAGS_graph_file, dcb);
+  }
+  
+  if (!FLAGS_save_index.empty() && !dch->Save(FLAGS_save_index)){
+    cerr << FLAGS_save_index << ": Cannot save the index." << endl;
+    exit(EXIT_FAILURE);
+  }
+  
+  if (!FLAGS_checkpoint_file.empty() && !recovered){
+    // a log left from an older index cannot be replayed on this one
+    if (!FLAGS_update_log.empty()) remove(FLAGS_update_log.c_str());
+    if (!dch->Checkpoint(FLAGS_checkpoint_file) ||
+        (!FLAGS_update_log.empty() && !dch->OpenUpdateLog(FLAGS_update_log))){
+      cerr << FLAGS_checkpoint_file << ": Cannot write a checkpoint." << endl;
+      exit(EXIT_FAILURE);
+    }
+  }
 
   if (FLAGS_query_file == "-"){
     ProcessQueries(cin, dcb);
@@ -0,0 +1,141 @@
+#include "gtest/gtest.h"
+#include "algorithm/graph_io.hpp"
+#include "algorithm/dynamic_centrality_hay.hpp"
+#include "algorithm/centrality_brandes.hpp"
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+using namespace std;
+using namespace betweenness_centrality;
+
+namespace {
+  const string kPath = "graph_io_test.graph";
+}
+
+TEST(GRAPH_IO, TEXT_FORMAT){
+  {
+    ofstream ofs(kPath.c_str(), ios::binary);
+    ofs << "# Directed graph\n# FromNodeId\tToNodeId\n1\t2\n\n  3 4 extra columns\r\n-5 6\n7\t8\n2147483647 -2147483648";
+  }
+  vector<pair<int, int> > es;
+  ASSERT_TRUE(ReadTextGraph(kPath, es));
+  vector<pair<int, int> > expected = {{1, 2}, {3, 4}, {-5, 6}, {7, 8}, {INT_MAX, INT_MIN}};
+  ASSERT_EQ(expected, es);
+
+  for (const char *broken : {"1 2\n3\n", "1 2\n3 x\n", "1 2\n3 4x\n",
+                             "1 2\n2147483648 0\n", "1 -2147483649\n", "1 99999999999999999999999\n"}){
+    {
+      ofstream ofs(kPath.c_str(), ios::binary);
+      ofs << broken;
+    }
+    ASSERT_FALSE(ReadTextGraph(kPath, es)) << broken;
+  }
+  ASSERT_FALSE(ReadTextGraph(kPath + ".missing", es));
+  remove(kPath.c_str());
+}
+
+TEST(GRAPH_IO, TEXT_CHUNKS){
+  // large enough to be split into several chunks, whose boundaries fall in the middle of lines
+  srand(0);
+  vector<pair<int, int> > expected;
+  {
+    ofstream ofs(kPath.c_str(), ios::binary);
+    for (int i = 0; i < 300000; i++){
+      if (i % 1000 == 0) ofs << "# comment " << i << "\n";
+      expected.emplace_back(rand() % 1000000, rand() % 1000000);
+      ofs << expected.back().fst << "\t" << expected.back().snd << "\n";
+    }
+  }
+  for (int num_threads : {1, 2, 3, 8}){
+    vector<pair<int, int> > es;
+    ASSERT_TRUE(ReadTextGraph(kPath, es, num_threads));
+    ASSERT_EQ(expected, es) << num_threads;
+  }
+  remove(kPath.c_str());
+}
+
+TEST(GRAPH_IO, CSR_LAYOUT){
+  // vertices are numbered by their first appearance: 10 -> 0, 7 -> 1, 3 -> 2
+  vector<pair<int, int> > es = {{10, 7}, {3, 10}, {10, 3}, {7, 7}, {10, 7}, {7, 3}};
+  ASSERT_TRUE(WriteBinaryGraph(kPath, es));
+  
+  MappedGraph graph;
+  ASSERT_TRUE(graph.Open(kPath));
+  ASSERT_EQ(3u, graph.NumVertices());
+  ASSERT_EQ(es.size(), graph.NumEdges());
+  vector<uint64_t> offsets(graph.Offsets(), graph.Offsets() + 4);
+  vector<int32_t>  targets(graph.Targets(), graph.Targets() + offsets[3]);
+  vector<int32_t>  ids(graph.OriginalIds(), graph.OriginalIds() + 3);
+  ASSERT_EQ(vector<uint64_t>({0, 3, 4, 5}), offsets);
+  ASSERT_EQ(vector<int32_t>({1, 1, 2, 2, 0}), targets);
+  ASSERT_EQ(vector<int32_t>({10, 7, 3}), ids);
+  
+  vector<pair<int, int> > expected = {{10, 7}, {10, 7}, {10, 3}, {7, 3}, {3, 10}};
+  ASSERT_EQ(expected, graph.ToEdgeList());
+  remove(kPath.c_str());
+}
+
+TEST(GRAPH_IO, SAME_INDEX_AS_EDGE_LIST){
+  srand(0);
+  vector<pair<int, int> > es;
+  for (int i = 0; i < 400; i++) es.emplace_back(rand() % 100 * 3, rand() % 100 * 3);
+  ASSERT_TRUE(WriteBinaryGraph(kPath, es));
+  MappedGraph graph;
+  ASSERT_TRUE(graph.Open(kPath));
+  
+  DynamicCentralityHAY from_text, from_binary;
+  srand(1);
+  from_text.PreCompute(es, 1000);
+  srand(1);
+  from_binary.PreCompute(graph, 1000);
+  for (int v = 0; v < 300; v++){
+    ASSERT_EQ(from_text.QueryCentrality(v), from_binary.QueryCentrality(v)) << v;
+  }
+  remove(kPath.c_str());
+}
+
+TEST(GRAPH_IO, SELF_LOOP_ONLY_VERTEX){
+  // 5 appears only in a self loop, and 7 in one besides its other edges
+  vector<pair<int, int> > es = {{1, 2}, {5, 5}, {7, 7}, {2, 7}};
+  ASSERT_TRUE(WriteBinaryGraph(kPath, es));
+  MappedGraph graph;
+  ASSERT_TRUE(graph.Open(kPath));
+  ASSERT_EQ(4u, graph.NumVertices());
+  vector<pair<int, int> > expected = {{1, 2}, {2, 7}, {5, 5}};
+  ASSERT_EQ(expected, graph.ToEdgeList());
+  
+  // classes without their own PreCompute for binary graphs read ToEdgeList
+  CentralityBrandes from_text, from_binary;
+  from_text.PreCompute(es);
+  static_cast<CentralityBase&>(from_binary).PreCompute(graph);
+  vector<pair<int, double> > text_scores, binary_scores;
+  from_text.QueryAllCentralities(text_scores);
+  from_binary.QueryAllCentralities(binary_scores);
+  sort(text_scores.begin(), text_scores.end());
+  sort(binary_scores.begin(), binary_scores.end());
+  ASSERT_EQ(text_scores, binary_scores);
+  remove(kPath.c_str());
+}
+
+TEST(GRAPH_IO, REJECT_BROKEN_FILE){
+  vector<pair<int, int> > es = {{0, 1}, {1, 2}, {2, 0}};
+  ASSERT_TRUE(WriteBinaryGraph(kPath, es));
+  MappedGraph graph;
+  {
+    // an offset past the end of the targets
+    fstream fs(kPath.c_str(), ios::in | ios::out | ios::binary);
+    fs.seekp(32 + 8);
+    fs.put(100);
+  }
+  ASSERT_FALSE(graph.Open(kPath));
+  {
+    ofstream ofs(kPath.c_str(), ios::binary);
+    ofs << "0 1\n1 2\n";
+  }
+  ASSERT_FALSE(graph.Open(kPath));
+  ASSERT_FALSE(graph.Open(kPath + ".missing"));
+  remove(kPath.c_str());
+}
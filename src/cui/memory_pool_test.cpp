@@ -0,0 +1,82 @@
+#include "gtest/gtest.h"
+#include "algorithm/memory_pool.hpp"
+#include "algorithm/hyper_edge.hpp"
+#include <thread>
+#include <vector>
+using namespace std;
+using namespace betweenness_centrality;
+
+TEST(MEMORY_POOL, REUSE_FREED_BLOCK){
+  void *p = MemoryPool::Allocate(100);
+  MemoryPool::Deallocate(p, 100);
+  void *q = MemoryPool::Allocate(128);
+  ASSERT_EQ(p, q);
+  MemoryPool::Deallocate(q, 128);
+}
+
+TEST(MEMORY_POOL, LARGE_BLOCK){
+  size_t n = size_t(1) << 20;
+  char *p = static_cast<char*>(MemoryPool::Allocate(n));
+  p[0] = p[n - 1] = 1;
+  MemoryPool::Deallocate(p, n);
+}
+
+TEST(MEMORY_POOL, STABLE_UNDER_CHURN){
+  size_t reserved = 0;
+  for (int round = 0; round < 10; round++){
+    vector<hash_map<int, double> *> maps;
+    for (int i = 0; i < 100; i++){
+      auto *m = new hash_map<int, double>();
+      m->set_empty_key(-1);
+      m->set_deleted_key(-2);
+      for (int v = 0; v < i * 10; v++) (*m)[v] = v;
+      maps.push_back(m);
+    }
+    for (auto m : maps) delete m;
+
+    if (round == 0){
+      reserved = MemoryPool::GetReservedBytes();
+    } else {
+      ASSERT_EQ(reserved, MemoryPool::GetReservedBytes());
+    }
+  }
+}
+
+TEST(MEMORY_POOL, FREE_ON_OTHER_THREADS){
+  const int num_threads = 4;
+  const int num_blocks  = 10000;
+  vector<vector<void*> > blocks(num_threads);
+
+  vector<thread> ths;
+  for (int i = 0; i < num_threads; i++){
+    ths.emplace_back([&, i]{
+        for (int k = 0; k < num_blocks; k++){
+          blocks[i].push_back(MemoryPool::Allocate(16 << (k % 8)));
+        }
+      });
+  }
+  for (auto &th : ths) th.join();
+  ths.clear();
+
+  // every thread frees the blocks of the next one, and exits with them cached
+  for (int i = 0; i < num_threads; i++){
+    ths.emplace_back([&, i]{
+        auto &bs = blocks[(i + 1) % num_threads];
+        for (int k = 0; k < num_blocks; k++){
+          MemoryPool::Deallocate(bs[k], 16 << (k % 8));
+        }
+      });
+  }
+  for (auto &th : ths) th.join();
+
+  // the blocks have been handed to the shared pool and are reused
+  size_t reserved = MemoryPool::GetReservedBytes();
+  vector<void*> bs;
+  for (int k = 0; k < num_blocks; k++){
+    bs.push_back(MemoryPool::Allocate(16 << (k % 8)));
+  }
+  ASSERT_EQ(reserved, MemoryPool::GetReservedBytes());
+  for (int k = 0; k < num_blocks; k++){
+    MemoryPool::Deallocate(bs[k], 16 << (k % 8));
+  }
+}
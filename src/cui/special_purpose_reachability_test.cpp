@@ -2,6 +2,8 @@
 #include "common.hpp"
 #include "gtest/gtest.h"
 using namespace betweenness_centrality::special_purpose_reachability_index;
+using betweenness_centrality::BitMask;
+using betweenness_centrality::ThreadPool;
 using namespace std;
 
 template <typename T> using Matrix = vector<vector<T> > ;
@@ -24,10 +26,10 @@ void Check(const Matrix<int> &adj_matrix, const pair<SPRIndex*, Matrix<Reachabil
       if (i != j){
         ASSERT_EQ(reach[i][j], p.second[i][j]->Reach()) 
           << "source: " << i << "\t" << "target: " << j << "\t"
-          << "roots:  " << p.first->GetRoots() << "\t"
-          << "reach:  " << p.second[i][j]->GetIndexNodes() << endl
-          << "trees:  " << p.first->GetTrees() << endl
-          << "graph:  " << adj_matrix << endl;
+          << "roots:  " << ::testing::PrintToString(p.first->GetRoots()) << "\t"
+          << "reach:  " << ::testing::PrintToString(p.second[i][j]->GetIndexNodes()) << endl
+          << "trees:  " << ::testing::PrintToString(p.first->GetTrees()) << endl
+          << "graph:  " << ::testing::PrintToString(adj_matrix) << endl;
       }
     }
   }
@@ -66,9 +68,10 @@ pair<Matrix<int>, Matrix<int> > BuildAdj(const Matrix<int> &adj_mat){
   return make_pair(fg, bg);
 }
 
-pair<SPRIndex*, Matrix<ReachabilityQuerier*> > BuildIndex(Matrix<int> &fg, Matrix<int> &bg, int num_trees){
+pair<SPRIndex*, Matrix<ReachabilityQuerier*> > BuildIndex(Matrix<int> &fg, Matrix<int> &bg, int num_trees,
+                                                           RootSelection selection = RANDOM_ROOTS, ThreadPool *pool = nullptr){
   int n = fg.size();
-  SPRIndex *pr_index = new SPRIndex(&fg, &bg, num_trees);
+  SPRIndex *pr_index = new SPRIndex(&fg, &bg, num_trees, pool, selection);
   Matrix<ReachabilityQuerier*> prqs(n, vector<ReachabilityQuerier*>(n, nullptr));
 
   for (int i = 0; i < n; i++){
@@ -82,12 +85,12 @@ pair<SPRIndex*, Matrix<ReachabilityQuerier*> > BuildIndex(Matrix<int> &fg, Matri
 }
 
 
-void StaticTest(int n, int q, double thres, int num_trees){
+void StaticTest(int n, int q, double thres, int num_trees, RootSelection selection = RANDOM_ROOTS){
   srand(0);
   while(q--){
     Matrix<int> adj_matrix(GenerateERGraph(n, thres));
     auto adj_list = BuildAdj(adj_matrix);
-    auto index = BuildIndex(adj_list.first, adj_list.second, num_trees);
+    auto index = BuildIndex(adj_list.first, adj_list.second, num_trees, selection);
     Check(adj_matrix, index);
     delete index.first;
   }
@@ -254,7 +257,7 @@ void EdgeDeleteTest(int n, int q, int num_trees){
   }
 }
 
-void EdgeRandomTest(int n, int q, int num_trees){
+void EdgeRandomTest(int n, int q, int num_trees, ThreadPool *pool = nullptr){
   srand(0);
   while(q--){
     Matrix<int> adj_matrix(GenerateERGraph(n, -1));
@@ -267,7 +270,7 @@ void EdgeRandomTest(int n, int q, int num_trees){
     }
     
     auto adj_lists = BuildAdj(adj_matrix);
-    auto p = BuildIndex(adj_lists.first, adj_lists.second, num_trees);
+    auto p = BuildIndex(adj_lists.first, adj_lists.second, num_trees, RANDOM_ROOTS, pool);
 
 
     for (int c = 0; c < 20; c++){
@@ -303,12 +306,12 @@ void NodeInsertTest(int n, int q, int num_trees){
   }
 }
 
-void NodeDeleteTest(int n, int q, int num_trees){
+void NodeDeleteTest(int n, int q, int num_trees, ThreadPool *pool = nullptr){
   srand(0);
   while (q--){
     Matrix<int> adj_matrix(GenerateERGraph(n, 0.5));
     auto adj_lists = BuildAdj(adj_matrix);
-    auto p = BuildIndex(adj_lists.first, adj_lists.second, num_trees);
+    auto p = BuildIndex(adj_lists.first, adj_lists.second, num_trees, RANDOM_ROOTS, pool);
 
     vector<int> active(n, true);
 
@@ -323,6 +326,32 @@ void NodeDeleteTest(int n, int q, int num_trees){
   }
 }
 
+void AdaptiveRootsTest(int n, int q, int num_trees){
+  srand(0);
+  uint64_t num_swaps = 0;
+  while (q--){
+    Matrix<int> adj_matrix(GenerateERGraph(n, 0.1));
+    auto adj_lists = BuildAdj(adj_matrix);
+    auto p = BuildIndex(adj_lists.first, adj_lists.second, num_trees);
+    p.first->SetAdaptInterval(1);
+
+    for (int c = 0; c < 50; c++){
+      int s = rand() % n, t = rand() % n;
+      while (s == t) {s = rand () % n, t = rand() % n; }
+      
+      if (adj_matrix[s][t]){
+        DeleteEdge(adj_lists, adj_matrix, p.first, s, t);
+      } else {
+        InsertEdge(adj_lists, adj_matrix, p.first, s, t);
+      }
+      Check(adj_matrix, p);
+    }
+    num_swaps += p.first->GetNumSwaps();
+    delete p.first;
+  }
+  ASSERT_GT(num_swaps, 0u);
+}
+
 void NodeDeleteWithoutRootsTest(int n, int q, int num_trees){
   srand(0);
   while (q--){
@@ -397,3 +426,79 @@ TEST(REACHABILITY_NODE_DELETE, WITH_TREE_TINY){ NodeDeleteTest(tiny_V, tiny_num_
 TEST(REACHABILITY_NODE_DELETE, WITH_TREE_SMALL){ NodeDeleteTest(small_V, small_num_graph, 5); }
 TEST(REACHABILITY_NODE_DELETE, WITH_TREE_MIDDLE){ NodeDeleteTest(middle_V, middle_num_graph, 5); }
 
+TEST(REACHABILITY_STATIC, DEGREE_ROOTS_SMALL015){ StaticTest(small_V, small_num_graph, 0.15, 5, DEGREE_ROOTS); }
+TEST(REACHABILITY_STATIC, SCC_ROOTS_SMALL015){ StaticTest(small_V, small_num_graph, 0.15, 5, SCC_ROOTS); }
+TEST(REACHABILITY_STATIC, SCC_ROOTS_TINY){ StaticTest(tiny_V, tiny_num_graph, 0.20, 8, SCC_ROOTS); }
+TEST(REACHABILITY_EDGE_RANDOM, ADAPTIVE_ROOTS_SMALL){ AdaptiveRootsTest(small_V, small_num_graph, 2); }
+TEST(REACHABILITY_EDGE_RANDOM, ADAPTIVE_ROOTS_MIDDLE){ AdaptiveRootsTest(middle_V, middle_num_graph, 3); }
+
+TEST(REACHABILITY_ROOTS, SELECTION){
+  // components {0, 1, 2}, {3, 4}, {5} and {6}; 1 and 6 have the highest degree
+  Matrix<int> adj_matrix(7, vector<int>(7, 0));
+  vector<pair<int, int> > es = {{0, 1}, {1, 0}, {1, 2}, {2, 1}, {3, 4}, {4, 3}, {4, 5}, {6, 0}, {6, 2}, {6, 3}, {6, 5}};
+  for (auto e : es) adj_matrix[e.fst][e.snd] = 1;
+  auto adj_lists = BuildAdj(adj_matrix);
+  
+  // one root for each component from the largest, and then the others
+  SPRIndex scc_index(&adj_lists.first, &adj_lists.second, 6, nullptr, SCC_ROOTS);
+  vector<int> expected = {1, 3, 5, 6, 0, 2};
+  ASSERT_EQ(expected, scc_index.GetRoots());
+  
+  SPRIndex degree_index(&adj_lists.first, &adj_lists.second, 2, nullptr, DEGREE_ROOTS);
+  expected = {1, 6};
+  ASSERT_EQ(expected, degree_index.GetRoots());
+}
+
+// the roots adapt to the searches of the queriers for edge updates, not only when they are built
+TEST(REACHABILITY_ROOTS, ADAPT_ON_EDGE_UPDATES){
+  // components {0, 1, 2}, {3}, {4, 5} and {6}; the root in {4, 5} prunes nothing
+  Matrix<int> adj_matrix(7, vector<int>(7, 0));
+  vector<pair<int, int> > es = {{0, 1}, {1, 0}, {1, 2}, {2, 0}, {0, 2}, {2, 3}, {4, 5}, {5, 4}};
+  for (auto e : es) adj_matrix[e.fst][e.snd] = 1;
+  auto adj_lists = BuildAdj(adj_matrix);
+  auto p = BuildIndex(adj_lists.first, adj_lists.second, 2, SCC_ROOTS);
+  int kept_root = p.first->GetRoots()[0];
+  
+  // the edge stays inside {0, 1, 2}, so no mask changes and no querier is built again
+  p.first->SetAdaptInterval(p.first->GetPruneCounts().tests + 1);
+  for (int c = 0; c < 10 && p.first->GetNumSwaps() == 0; c++){
+    DeleteEdge(adj_lists, adj_matrix, p.first, 0, 2);
+    InsertEdge(adj_lists, adj_matrix, p.first, 0, 2);
+    Check(adj_matrix, p);
+  }
+  ASSERT_EQ(1u, p.first->GetNumSwaps());
+  ASSERT_EQ(kept_root, p.first->GetRoots()[0]);
+  delete p.first;
+}
+
+// more roots than bits in an int
+TEST(REACHABILITY_STATIC, MANY_TREES_MIDDLE005){ StaticTest(middle_V, middle_num_graph, 0.05, 60); }
+TEST(REACHABILITY_EDGE_RANDOM, MANY_TREES_MIDDLE){ EdgeRandomTest(middle_V, middle_num_graph, 60); }
+
+// the trees and the queriers are updated on several threads
+TEST(REACHABILITY_EDGE_RANDOM, THREADS_MIDDLE){
+  ThreadPool pool(4);
+  EdgeRandomTest(middle_V, middle_num_graph, 5, &pool);
+}
+TEST(REACHABILITY_NODE_DELETE, THREADS_MIDDLE){
+  ThreadPool pool(4);
+  NodeDeleteTest(middle_V, middle_num_graph, 5, &pool);
+}
+
+TEST(REACHABILITY_MASK, MULTI_WORD){
+  BitMask<3> a, b;
+  a.Set(3, true);
+  a.Set(70, true);
+  a.Set(191, true);
+  b.Set(70, true);
+  ASSERT_TRUE(a.Test(191) && !a.Test(190));
+  ASSERT_TRUE(a.Intersects(b) && a.AnyNotIn(b) && !b.AnyNotIn(a));
+  
+  vector<int> bits, expected = {3, 191};
+  a.AndNot(b).ForEachBit([&](int k){ bits.push_back(k); });
+  ASSERT_EQ(expected, bits);
+  
+  a.Set(70, false);
+  ASSERT_FALSE(a.Intersects(b));
+  ASSERT_TRUE(a != b && (a & b) == BitMask<3>());
+}